@@ -0,0 +1,111 @@
+/******************************************************************************************
+ * Benchmarks for the buffers that connect two Executers.
+ *      1. JitteredHandoff: A producer and a consumer thread exchange items through a
+ *          buffer. Both sides have the same average cost per item, but every 8th item
+ *          is 8 times more expensive, on the producer and the consumer side out of phase.
+ *          With one slot, every spike stalls the other side. With more slots, the spikes
+ *          are absorbed and the throughput approaches the one of the average cost.
+ *          With a cost of 0, it is the raw throughput of the buffer.
+ *      2. PingPong: One item travels to an echo thread and back through two buffers.
+ *          The time per iteration is the round trip, i.e. two hand-offs, without any
+ *          work on either side, so it only measures the cost of the synchronization.
+ *          The argument is the wait policy of both buffers (0: Block, 1: SpinYield, 2: Spin),
+ *          so the result is also the wake-up latency of the waiting thread per policy.
+ *****************************************************************************************/
+#include <benchmark/benchmark.h>
+
+#include <thread>
+
+#include <uniquebuffer.hpp>
+#include <ringbuffer.hpp>
+#include <spscbuffer.hpp>
+
+using namespace parallelOperators;
+
+// Busy work, simulating the cost of an operation.
+static void burn(int iterations)
+{
+    for (int i = 0; i < iterations; i++)
+    {
+        benchmark::DoNotOptimize(i);
+    }
+}
+
+// Cost of item i. Every 8th item is a spike, 8 times more expensive than the others.
+static int jitteredCost(int i, int baseCost)
+{
+    return (i % 8 == 0) ? 8 * baseCost : baseCost;
+}
+
+//----------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------
+template <class BUFFER>
+static void BM_JitteredHandoff(benchmark::State & state)
+{
+    const int items = 256;
+    const int baseCost = state.range(0);
+    for (auto _ : state)
+    {
+        BUFFER buffer("bench_buffer");
+        thread consumer([&buffer, baseCost]()
+        {
+            auto data = make_unique<int>();
+            for (int i = 0; i < items; i++)
+            {
+                buffer.receive(data);
+                burn(jitteredCost(i + 4, baseCost));
+            }
+        });
+        auto data = make_unique<int>();
+        for (int i = 0; i < items; i++)
+        {
+            burn(jitteredCost(i, baseCost));
+            *data = i;
+            buffer.send(data);
+        }
+        consumer.join();
+    }
+    state.SetItemsProcessed(state.iterations() * items);
+}
+
+BENCHMARK_TEMPLATE(BM_JitteredHandoff, UniqueBuffer<int>)->Arg(0)->Arg(1000)->Arg(10000)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_JitteredHandoff, RingBuffer<int, 2>)->Arg(0)->Arg(1000)->Arg(10000)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_JitteredHandoff, RingBuffer<int, 4>)->Arg(0)->Arg(1000)->Arg(10000)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_JitteredHandoff, RingBuffer<int, 16>)->Arg(0)->Arg(1000)->Arg(10000)->UseRealTime();
+
+//----------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------
+template <class BUFFER>
+static void BM_PingPong(benchmark::State & state)
+{
+    BUFFER ping("ping");
+    BUFFER pong("pong");
+    ping.waitPolicy(static_cast<WaitPolicy>(state.range(0)));
+    pong.waitPolicy(static_cast<WaitPolicy>(state.range(0)));
+    atomic_bool ending = false;
+    thread echo([&]()
+    {
+        auto data = make_unique<int>();
+        while (!ending.load())
+        {
+            ping.receive(data);
+            pong.send(data);
+        }
+    });
+    auto data = make_unique<int>();
+    for (auto _ : state)
+    {
+        ping.send(data);
+        pong.receive(data);
+    }
+    ending.store(true);
+    ping.releaseAll();
+    pong.releaseAll();
+    echo.join();
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK_TEMPLATE(BM_PingPong, UniqueBuffer<int>)->ArgName("policy")->DenseRange(WaitPolicy::Block, WaitPolicy::Spin)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_PingPong, RingBuffer<int, 4>)->ArgName("policy")->DenseRange(WaitPolicy::Block, WaitPolicy::Spin)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_PingPong, SpscBuffer<int>)->ArgName("policy")->DenseRange(WaitPolicy::Block, WaitPolicy::Spin)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_PingPong, SpscBuffer<int, 4>)->ArgName("policy")->DenseRange(WaitPolicy::Block, WaitPolicy::Spin)->UseRealTime();
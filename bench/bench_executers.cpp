@@ -0,0 +1,257 @@
+/******************************************************************************************
+ * Benchmarks for chains of Executers, each running in its own thread.
+ *      1. ChainLatency: One item at a time through a chain of 1, 2, 4 or 8 OperatorExecuters,
+ *          each with one Add5 operator from test/classdefs.hpp. The time per iteration is the
+ *          time from sending the item into the first Executer until it is received from the
+ *          last one, i.e. one hand-off more than the number of stages.
+ *      2. ChainThroughput: The same chains, but a producer thread keeps the chain full, so the
+ *          stages work in parallel. Reported as items per second.
+ *      3. Payload: A two-stage chain with payloads from an int up to an 8 MB frame. The
+ *          operators only touch one byte, so the time shows the cost of the hand-off itself,
+ *          which should not depend on the size since the data is swapped and not copied.
+ *      4. StepMode: A two-stage chain where every item needs a Step command to each Executer,
+ *          compared with the same chain in Continuous mode. The commands for an item are
+ *          sent after the item before it has come out of the chain, and after the item itself
+ *          has been sent, so the Executers are waiting for the command when it arrives, and
+ *          the time includes waking them up.
+ *      5. Batches: The chain Mult2 -> Div2Round -> Add5 -> Div2 from test/classdefs.hpp, with
+ *          one Executer per operator between a source and a sink, built with Pipeline. The
+ *          items pass one by one, or in batches of 8 or 64 with Batched<Op, N>, so that
+ *          each hand-off is shared by the items of a batch. Reported as items per second.
+ *      The results can be written as JSON with the bench_json target, or with
+ *          bench_core --benchmark_out=bench_core.json --benchmark_out_format=json
+ *****************************************************************************************/
+#include <benchmark/benchmark.h>
+
+#include <array>
+#include <vector>
+#include <memory>
+#include <cmath>
+#include <cstdint>
+
+#include "classdefs.hpp"
+
+// A chain of stages, each an OperatorExecuter with one Add5 operator, connected in order.
+class AddChain
+{
+public:
+    AddChain(int stages, ExecutionMode mode)
+    {
+        for (int i = 0; i < stages; i++)
+        {
+            _operators.emplace_back(std::make_unique<Add5>("add_5_" + std::to_string(i)));
+            _executers.emplace_back(std::make_unique<OperatorExecuter<float, float>>("Stage_" + std::to_string(i)));
+            _executers[i]->addOperator(_operators[i].get());
+            _executers[i]->opInput(_operators[i]->inputAddress());
+            _executers[i]->opOutput(_operators[i]->outputAddress());
+            if (i > 0) _executers[i]->input(_executers[i - 1]->output());
+        }
+        for (auto & e : _executers)
+        {
+            e->send(ExecutionMode(mode));
+            e->startThread();
+        }
+    };
+    ~AddChain()
+    {
+        for (auto & e : _executers) e->stop();
+        for (auto & e : _executers) e->waitToEnd();
+    };
+
+    std::shared_ptr<BaseBuffer<float>> input() { return _executers.front()->input(); };
+    std::shared_ptr<BaseBuffer<float>> output() { return _executers.back()->output(); };
+    void step()
+    {
+        for (auto & e : _executers) e->send(ExecutionMode::Step);
+    };
+
+private:
+    std::vector<std::unique_ptr<Add5>> _operators;
+    std::vector<std::unique_ptr<OperatorExecuter<float, float>>> _executers;
+};
+
+//----------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------
+static void BM_ChainLatency(benchmark::State & state)
+{
+    AddChain chain((int) state.range(0), ExecutionMode::Continuous);
+    auto input = std::make_unique<float>(0.0f);
+    auto output = std::make_unique<float>();
+    for (auto _ : state)
+    {
+        chain.input()->send(input);
+        chain.output()->receive(output);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ChainLatency)->ArgName("stages")->RangeMultiplier(2)->Range(1, 8)->UseRealTime();
+
+//----------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------
+static void BM_ChainThroughput(benchmark::State & state)
+{
+    const int items = 256;
+    AddChain chain((int) state.range(0), ExecutionMode::Continuous);
+    auto output = std::make_unique<float>();
+    for (auto _ : state)
+    {
+        std::thread producer([&chain]()
+        {
+            auto input = std::make_unique<float>();
+            for (int i = 0; i < items; i++)
+            {
+                *input = i;
+                chain.input()->send(input);
+            }
+        });
+        for (int i = 0; i < items; i++) chain.output()->receive(output);
+        producer.join();
+    }
+    state.SetItemsProcessed(state.iterations() * items);
+}
+BENCHMARK(BM_ChainThroughput)->ArgName("stages")->RangeMultiplier(2)->Range(1, 8)->UseRealTime();
+
+//----------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------
+template <size_t N>
+struct Payload
+{
+    std::array<uint8_t, N> data {};
+};
+
+template <size_t N>
+class TouchPayload : public Operator<Payload<N>, Payload<N>>
+{
+public:
+    TouchPayload(std::string opName): Operator<Payload<N>, Payload<N>>(opName) {};
+    OperationStatus operation() override
+    {
+        this->_output->data[0] = this->_input->data[0] + 1;
+        return OperationStatus::running;
+    };
+};
+
+template <size_t N>
+static void BM_Payload(benchmark::State & state)
+{
+    TouchPayload<N> op1("touch_1");
+    TouchPayload<N> op2("touch_2");
+    OperatorExecuter<Payload<N>, Payload<N>> exec1("Exec_1");
+    OperatorExecuter<Payload<N>, Payload<N>> exec2("Exec_2");
+    exec1.addOperator(&op1);
+    exec1.opInput(op1.inputAddress());
+    exec1.opOutput(op1.outputAddress());
+    exec2.addOperator(&op2);
+    exec2.opInput(op2.inputAddress());
+    exec2.opOutput(op2.outputAddress());
+    exec2.input(exec1.output());
+    exec1.send(ExecutionMode::Continuous);
+    exec2.send(ExecutionMode::Continuous);
+    exec1.startThread();
+    exec2.startThread();
+
+    auto input = std::make_unique<Payload<N>>();
+    auto output = std::make_unique<Payload<N>>();
+    for (auto _ : state)
+    {
+        exec1.input()->send(input);
+        exec2.output()->receive(output);
+    }
+    exec1.stop();
+    exec2.stop();
+    exec1.waitToEnd();
+    exec2.waitToEnd();
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * N);
+}
+BENCHMARK_TEMPLATE(BM_Payload, sizeof(int))->UseRealTime();
+BENCHMARK_TEMPLATE(BM_Payload, 1 << 10)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_Payload, 64 << 10)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_Payload, 1 << 20)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_Payload, 8 << 20)->UseRealTime();
+
+//----------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------
+static void BM_StepMode(benchmark::State & state)
+{
+    const bool stepping = (state.range(0) == ExecutionMode::Step);
+    AddChain chain(2, stepping ? ExecutionMode::Step : ExecutionMode::Continuous);
+    auto input = std::make_unique<float>(0.0f);
+    auto output = std::make_unique<float>();
+    for (auto _ : state)
+    {
+        chain.input()->send(input);
+        if (stepping) chain.step();
+        chain.output()->receive(output);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_StepMode)->ArgName("mode")->DenseRange(ExecutionMode::Step, ExecutionMode::Continuous)->UseRealTime();
+
+//----------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------
+// Delivers the given number of ints, 0, 1, 2, ... and completes with the last.
+class IntSource : public SourceOperator<int>
+{
+public:
+    IntSource(std::string opName, int items): SourceOperator(opName), _items(items) {};
+    OperationStatus operation() override
+    {
+        *_output = _counter++;
+        return (_counter < _items) ? OperationStatus::running : OperationStatus::complete;
+    };
+
+private:
+    int _counter {0};
+    int _items;
+};
+
+const int chainItems = 1 << 16;
+
+static void BM_ItemChain(benchmark::State & state)
+{
+    for (auto _ : state)
+    {
+        IntSource source("int_source", chainItems);
+        Mult2 op1("multiply_2.1");
+        Div2Round op2("divide_2_floor");
+        Add5 op3("add_5");
+        Div2 op4("divide_2");
+        CounterSink sink("counter_sink");
+        Pipeline pipeline("Items");
+        pipeline.source(source).stage(op1).stage(op2).stage(op3).stage(op4).sink(sink);
+        pipeline.start();
+        pipeline.drain();
+        benchmark::DoNotOptimize(sink.getValue());
+    }
+    state.SetItemsProcessed(state.iterations() * chainItems);
+}
+BENCHMARK(BM_ItemChain)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+template <size_t N>
+static void BM_BatchedChain(benchmark::State & state)
+{
+    for (auto _ : state)
+    {
+        IntSource source("int_source", chainItems);
+        Mult2 op1("multiply_2.1");
+        Div2Round op2("divide_2_floor");
+        Add5 op3("add_5");
+        Div2 op4("divide_2");
+        CounterSink sink("counter_sink");
+        BatchedSource<IntSource, N> bSource("batched_source", source);
+        Batched<Mult2, N> b1("batched_multiply_2.1", op1);
+        Batched<Div2Round, N> b2("batched_divide_2_floor", op2);
+        Batched<Add5, N> b3("batched_add_5", op3);
+        Batched<Div2, N> b4("batched_divide_2", op4);
+        BatchedSink<CounterSink, N> bSink("batched_sink", sink);
+        Pipeline pipeline("Batches");
+        pipeline.source(bSource).stage(b1).stage(b2).stage(b3).stage(b4).sink(bSink);
+        pipeline.start();
+        pipeline.drain();
+        benchmark::DoNotOptimize(sink.getValue());
+    }
+    state.SetItemsProcessed(state.iterations() * chainItems);
+}
+BENCHMARK_TEMPLATE(BM_BatchedChain, 8)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_BatchedChain, 64)->Unit(benchmark::kMillisecond)->UseRealTime();
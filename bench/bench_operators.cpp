@@ -0,0 +1,63 @@
+/******************************************************************************************
+ * Benchmarks for the execution of a chain of operators inside one Executer.
+ *      1. VirtualChain: Mult2 -> Div2Round -> Add5 -> Div2 from test/classdefs.hpp, added
+ *          one by one as in an Executer. Each operator is called through the virtual
+ *          operation() and each link is a separate buffer on the heap.
+ *      2. FusedChain: The same four operators in a FusedChain, called once per item.
+ *          The chain is called through the base class, as the Executer does, but inside
+ *          the chain there is no virtual dispatch.
+ *      The time per iteration is one item through all four operators.
+ *****************************************************************************************/
+#include <benchmark/benchmark.h>
+
+#include <vector>
+#include <memory>
+#include <cmath>
+
+#include "classdefs.hpp"
+
+static void BM_VirtualChain(benchmark::State & state)
+{
+    Mult2 op1("multiply_2.1");
+    Div2Round op2("divide_2_floor");
+    Add5 op3("add_5");
+    Div2 op4("divide_2");
+    op2.input(op1.output());
+    op3.input(op2.output());
+    op4.input(op3.output());
+    std::vector<BaseOperator *> operators {&op1, &op2, &op3, &op4};
+
+    int input = 0;
+    float output = 0;
+    op1.input(&input);
+    op4.output(&output);
+    for (auto _ : state)
+    {
+        input++;
+        for (auto op : operators) op->operation();
+        benchmark::DoNotOptimize(output);
+    }
+}
+BENCHMARK(BM_VirtualChain);
+
+static void BM_FusedChain(benchmark::State & state)
+{
+    Mult2 op1("multiply_2.1");
+    Div2Round op2("divide_2_floor");
+    Add5 op3("add_5");
+    Div2 op4("divide_2");
+    FusedChain<Mult2, Div2Round, Add5, Div2> chain("fused", op1, op2, op3, op4);
+    std::vector<BaseOperator *> operators {&chain};
+
+    int input = 0;
+    float output = 0;
+    chain.input(&input);
+    chain.output(&output);
+    for (auto _ : state)
+    {
+        input++;
+        for (auto op : operators) op->operation();
+        benchmark::DoNotOptimize(output);
+    }
+}
+BENCHMARK(BM_FusedChain);
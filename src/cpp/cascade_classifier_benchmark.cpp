@@ -0,0 +1,555 @@
+#include <string>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <filesystem>
+#include <vector>
+#include <map>
+#include <sstream>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <functional>
+
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#include <operator.hpp>
+#include <opsexecuter.hpp>
+#include <replicatedexecuter.hpp>
+#include <pipeline.hpp>
+#include <metrics.hpp>
+#include <cvoperators.hpp>
+#include <cvvideo.hpp>
+
+#include <opencv2/opencv.hpp>
+
+using namespace std;
+using namespace cv;
+using namespace parallelOperators;
+
+// The programs are run over the same images, without any question to the user, and each
+// of them in a process of its own, so that the peak memory of one does not hide the other,
+// and each of them parses the cascades in its own set up time.
+// The images are read once before the start, so that both find them in the page cache.
+
+struct RunSummary
+{
+    size_t frames;
+    uint64_t setupTime;         // Nanoseconds to create the operators and their classifiers
+    uint64_t wallTime;          // Nanoseconds from the first read to the last write
+    rusage before;              // Resource usage of the process at the start and at the end
+    rusage after;
+};
+
+uint64_t cpuNanoseconds(const rusage & usage)
+{
+    return ((uint64_t) usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000000 +
+           ((uint64_t) usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1000;
+}
+
+// The CPU time of every thread of the process, from /proc/self/task, also of the threads
+// that the Executers do not report: the workers of a pool, the collector of a replicated
+// Executer and the prefetcher. The threads are sampled every few milliseconds, since a
+// thread is gone from /proc when it ends, so the time of a thread that ends before stop()
+// may be short by one interval. The time before the start of the monitor is not counted.
+class ThreadCpuMonitor
+{
+public:
+    ThreadCpuMonitor()
+    {
+        _sample(true);
+        _thread = thread(&ThreadCpuMonitor::_run, this);
+    };
+    ~ThreadCpuMonitor() { stop(); };
+
+    // Takes the last sample and ends the sampling.
+    void stop()
+    {
+        _stopping = true;
+        if (_thread.joinable()) _thread.join();
+    };
+
+    void print(uint64_t wallTime) const
+    {
+        cout << "  thread CPU    : " << _threads.size() << " threads\n";
+        for (auto & [tid, t] : _threads)
+        {
+            uint64_t cpu = t.last - t.first;
+            cout << "    " << left << setw(36) << t.name + " (" + to_string(tid) + ")" << right
+                 << " cpu=" << setw(10) << cpu / 1e6 << " ms, busy=" << setw(6) << 100.0 * cpu / wallTime << " %\n";
+        }
+    };
+
+private:
+    struct ThreadTimes
+    {
+        string name;
+        uint64_t first;             // At the start of the monitor, 0 for a later thread
+        uint64_t last;
+    };
+
+    map<int, ThreadTimes> _threads;
+    atomic<bool> _stopping {false};
+    int _self {0};                  // The sampling thread, which is not reported
+    thread _thread;
+
+    void _run()
+    {
+        _self = (int) syscall(SYS_gettid);
+        while (!_stopping.load())
+        {
+            this_thread::sleep_for(chrono::milliseconds(5));
+            _sample(false);
+        }
+        _sample(false);
+    };
+
+    // The user and system time of each thread are the 14th and 15th fields of its stat
+    // file, in clock ticks, counted after its name, which may contain spaces.
+    void _sample(bool start)
+    {
+        static const uint64_t tick = 1000000000 / (uint64_t) sysconf(_SC_CLK_TCK);
+        error_code error;
+        for (const filesystem::directory_entry & entry : filesystem::directory_iterator("/proc/self/task", error))
+        {
+            int tid = stoi(entry.path().filename().string());
+            if (tid == _self) continue;
+            ifstream statFile(entry.path() / "stat");
+            string stat;
+            if (!getline(statFile, stat)) continue;
+            size_t open = stat.find('(');
+            size_t close = stat.rfind(')');
+            if ((open == string::npos) || (close == string::npos)) continue;
+            istringstream fields(stat.substr(close + 2));
+            string field;
+            for (int i = 3; i < 14; i++) fields >> field;
+            uint64_t user = 0;
+            uint64_t system = 0;
+            fields >> user >> system;
+            uint64_t cpu = (user + system) * tick;
+            auto found = _threads.find(tid);
+            if (found == _threads.end())
+            {
+                string name = threadName(tid);
+                if (name.empty()) name = stat.substr(open + 1, close - open - 1);
+                _threads[tid] = {name, start ? cpu : 0, cpu};
+            }
+            else found->second.last = cpu;
+        }
+    };
+};
+
+void printSummary(const RunSummary & run, const LatencyHistogram & latency, size_t faces)
+{
+    LatencySnapshot s = latency.snapshot();
+    uint64_t cpu = cpuNanoseconds(run.after) - cpuNanoseconds(run.before);
+    cout << fixed << setprecision(1);
+    cout << "  frames        : " << run.frames << ", " << faces << " faces found\n";
+    cout << "  set up        : " << run.setupTime / 1e6 << " ms\n";
+    cout << "  wall time     : " << run.wallTime / 1e6 << " ms\n";
+    cout << "  throughput    : " << setprecision(2) << run.frames / (run.wallTime / 1e9) << " frames/s\n" << setprecision(1);
+    cout << "  latency       : p50=" << s.p50 / 1e6 << " p99=" << s.p99 / 1e6 << " p999=" << s.p999 / 1e6
+         << " max=" << s.max / 1e6 << " ms\n";
+    cout << "  peak RSS      : " << run.after.ru_maxrss / 1024.0 << " MB\n";
+    cout << "  process CPU   : " << cpu / 1e6 << " ms, " << 100.0 * cpu / run.wallTime << " % of one core\n";
+}
+
+// The operators are called one after the other in the main thread, which is what the
+// single thread program does. With a maximum face fraction, only faces up to that fraction
+// of the shorter side of the image are searched for. With tiles, the face detection of each
+// image is split over a pool with one worker per core, and the eyes of the faces are searched
+// in parallel in the same pool. The tiles need a maximum face size, and are compared with the
+// single thread program with the same maximum, so that the speed-up is only the one of the
+// threads and not the one of the smaller search.
+double runSingleThread(const vector<filesystem::path> & sourceFiles, const vector<filesystem::path> & destinationFiles,
+                       const String & faceCascadeName, const String & eyesCascadeName, double maxFaceFraction, bool tiles)
+{
+    MetricsClock::time_point setup = MetricsClock::now();
+    CVFileReaderOp reader("Op_fileReader", sourceFiles, destinationFiles);
+    CVFaceDetector detector("FaceDetector", faceCascadeName);
+    CVEyeDetector eyes("EyeDetector", eyesCascadeName);
+    CVFileWriterOp writer("Op_fileWriter");
+    unique_ptr<WorkStealingPool> pool;
+    if (tiles) pool = make_unique<WorkStealingPool>();
+    detector.maxFaceFraction(maxFaceFraction);
+    if (!detector.loaded() || !eyes.loaded() || (tiles && !(detector.tiled(*pool) && eyes.parallel(*pool))))
+    {
+        cout << "--(!)Error loading face or eyes cascade\n";
+        return 0.0;
+    }
+    FramePool frames;
+    reader.pool(&frames);
+    detector.pool(&frames);
+    eyes.pool(&frames);
+    writer.pool(&frames);
+    ImageData read;
+    ImageData detected;
+    ImageData drawn;
+    LatencyHistogram latency;
+    reader.output(&read);
+    detector.input(&read);
+    detector.output(&detected);
+    eyes.input(&detected);
+    eyes.output(&drawn);
+    writer.input(&drawn);
+    writer.latency(&latency);
+
+    RunSummary run {sourceFiles.size(), elapsedNanoseconds(setup, MetricsClock::now()), 0, {}, {}};
+    getrusage(RUSAGE_SELF, &run.before);
+    ThreadCpuMonitor threads;
+    MetricsClock::time_point start = MetricsClock::now();
+    OperationStatus status = OperationStatus::running;
+    while (status == OperationStatus::running)
+    {
+        status = reader.operation();
+        detector.operation();
+        eyes.operation();
+        writer.operation();
+    }
+    run.wallTime = elapsedNanoseconds(start, MetricsClock::now());
+    threads.stop();
+    getrusage(RUSAGE_SELF, &run.after);
+
+    if (tiles) cout << "\nSingle thread, face detection in tiles on " << pool->workers() + 1 << " threads";
+    else cout << "\nSingle thread";
+    if (maxFaceFraction > 0.0) cout << ", faces up to " << maxFaceFraction << " of the shorter side";
+    cout << "\n";
+    printSummary(run, latency, detector.facesFound());
+    cout << "  image buffers : " << frames.created() << "\n";
+    threads.print(run.wallTime);
+    return run.frames / (run.wallTime / 1e9);
+}
+
+// The same pipeline as in the multithread program, with the face detector replicated on
+// the cores that are left after the reader and the writer, and the eye detector searching
+// the faces of each image in parallel. The writer encodes the images in the same pool.
+double runMultiThread(const vector<filesystem::path> & sourceFiles, const vector<filesystem::path> & destinationFiles,
+                      const String & faceCascadeName, const String & eyesCascadeName)
+{
+    MetricsClock::time_point setup = MetricsClock::now();
+    unsigned int cores = thread::hardware_concurrency();
+    size_t nDetectors = (cores > 3) ? cores - 2 : 1;
+    vector<unique_ptr<CVFaceDetector>> detectors;
+    WorkStealingPool eyesPool;
+    CVEyeDetector eyes("EyeDetector", eyesCascadeName);
+    for (size_t i = 0; i < nDetectors; i++)
+    {
+        detectors.emplace_back(make_unique<CVFaceDetector>("FaceDetector_" + to_string(i), faceCascadeName));
+        if (!detectors.back()->loaded())
+        {
+            cout << "--(!)Error loading face cascade\n";
+            return 0.0;
+        }
+    }
+    if (!eyes.loaded() || !eyes.parallel(eyesPool))
+    {
+        cout << "--(!)Error loading eyes cascade\n";
+        return 0.0;
+    }
+    CVFileReaderOp reader("Op_fileReader", sourceFiles, destinationFiles);
+    CVFileWriterOp writer("Op_fileWriter");
+    LatencyHistogram latency;
+    writer.latency(&latency);
+    FramePool frames;
+    reader.pool(&frames);
+    reader.prefetch(8, 256 << 20);
+    for (auto & detector : detectors) detector->pool(&frames);
+    eyes.pool(&frames);
+    writer.pool(&frames);
+    writer.encoders(eyesPool);
+
+    SourceExecuter<ImageData> readerThread("ReaderThread");
+    ReplicatedExecuter<ImageData, ImageData> detectorThread("DetectorThread", nDetectors);
+    OperatorExecuter<ImageData, ImageData> eyesThread("EyesThread");
+    SinkExecuter<ImageData> writerThread("WriterThread");
+
+    readerThread.addOperator(&reader);
+    readerThread.opOutput(reader.outputAddress());
+    for (size_t i = 0; i < nDetectors; i++)
+    {
+        detectorThread.replica(i).addOperator(detectors[i].get());
+        detectorThread.replica(i).opInput(detectors[i]->inputAddress());
+        detectorThread.replica(i).opOutput(detectors[i]->outputAddress());
+    }
+    eyesThread.addOperator(&eyes);
+    eyesThread.opInput(eyes.inputAddress());
+    eyesThread.opOutput(eyes.outputAddress());
+    writerThread.addOperator(&writer);
+    writerThread.opInput(writer.inputAddress());
+    detectorThread.input(readerThread.output());
+    eyesThread.input(detectorThread.output());
+    writerThread.input(eyesThread.output());
+
+    Pipeline pipeline("FaceDetection");
+    pipeline.add(readerThread).add(detectorThread).add(eyesThread).add(writerThread);
+
+    RunSummary run {sourceFiles.size(), elapsedNanoseconds(setup, MetricsClock::now()), 0, {}, {}};
+    getrusage(RUSAGE_SELF, &run.before);
+    ThreadCpuMonitor threads;
+    MetricsClock::time_point start = MetricsClock::now();
+    pipeline.start();
+    pipeline.drain();
+    writer.flush();
+    run.wallTime = elapsedNanoseconds(start, MetricsClock::now());
+    threads.stop();
+    getrusage(RUSAGE_SELF, &run.after);
+
+    size_t faces = 0;
+    for (auto & d : detectors) faces += d->facesFound();
+    cout << "\nMultithread, " << nDetectors << " detector threads\n";
+    printSummary(run, latency, faces);
+    cout << "  image buffers : " << frames.created() << "\n";
+    threads.print(run.wallTime);
+    cout << "\n";
+    pipeline.report(cout);
+    return run.frames / (run.wallTime / 1e9);
+}
+
+// A video through the multithread pipeline, from a video file to a video file. Without
+// live, every frame is processed and the throughput is the sustained rate of the pipeline.
+// With live, the frames arrive at the rate of the video, as from a camera, and the frames
+// that come while the pipeline is busy are dropped.
+double runVideo(const string & videoFile, const string & destinationFile,
+                const String & faceCascadeName, const String & eyesCascadeName, bool live)
+{
+    MetricsClock::time_point setup = MetricsClock::now();
+    unsigned int cores = thread::hardware_concurrency();
+    size_t nDetectors = (cores > 3) ? cores - 2 : 1;
+    vector<unique_ptr<CVFaceDetector>> detectors;
+    WorkStealingPool eyesPool;
+    CVEyeDetector eyes("EyeDetector", eyesCascadeName);
+    for (size_t i = 0; i < nDetectors; i++)
+    {
+        detectors.emplace_back(make_unique<CVFaceDetector>("FaceDetector_" + to_string(i), faceCascadeName));
+        if (!detectors.back()->loaded())
+        {
+            cout << "--(!)Error loading face cascade\n";
+            return 0.0;
+        }
+    }
+    if (!eyes.loaded() || !eyes.parallel(eyesPool))
+    {
+        cout << "--(!)Error loading eyes cascade\n";
+        return 0.0;
+    }
+    CVVideoSourceOp reader("Op_videoReader", videoFile);
+    if (!reader.opened())
+    {
+        cout << "--(!)Error opening " << videoFile << "\n";
+        return 0.0;
+    }
+    CVVideoWriterOp writer("Op_videoWriter", destinationFile, reader.fps());
+    LatencyHistogram latency;
+    writer.latency(&latency);
+    FramePool frames;
+    reader.pool(&frames);
+    for (auto & detector : detectors) detector->pool(&frames);
+    eyes.pool(&frames);
+    writer.pool(&frames);
+
+    SourceExecuter<ImageData> readerThread("ReaderThread");
+    ReplicatedExecuter<ImageData, ImageData> detectorThread("DetectorThread", nDetectors);
+    OperatorExecuter<ImageData, ImageData> eyesThread("EyesThread");
+    SinkExecuter<ImageData> writerThread("WriterThread");
+
+    readerThread.addOperator(&reader);
+    readerThread.opOutput(reader.outputAddress());
+    for (size_t i = 0; i < nDetectors; i++)
+    {
+        detectorThread.replica(i).addOperator(detectors[i].get());
+        detectorThread.replica(i).opInput(detectors[i]->inputAddress());
+        detectorThread.replica(i).opOutput(detectors[i]->outputAddress());
+    }
+    eyesThread.addOperator(&eyes);
+    eyesThread.opInput(eyes.inputAddress());
+    eyesThread.opOutput(eyes.outputAddress());
+    writerThread.addOperator(&writer);
+    writerThread.opInput(writer.inputAddress());
+    detectorThread.input(readerThread.output());
+    eyesThread.input(detectorThread.output());
+    writerThread.input(eyesThread.output());
+
+    Pipeline pipeline("VideoFaceDetection");
+    pipeline.add(readerThread).add(detectorThread).add(eyesThread).add(writerThread);
+
+    RunSummary run {0, elapsedNanoseconds(setup, MetricsClock::now()), 0, {}, {}};
+    getrusage(RUSAGE_SELF, &run.before);
+    ThreadCpuMonitor threads;
+    MetricsClock::time_point start = MetricsClock::now();
+    if (live) reader.latestFrameWins(reader.fps());
+    pipeline.start();
+    pipeline.drain();
+    writer.close();
+    run.wallTime = elapsedNanoseconds(start, MetricsClock::now());
+    threads.stop();
+    getrusage(RUSAGE_SELF, &run.after);
+    run.frames = writer.written();
+
+    size_t faces = 0;
+    for (auto & d : detectors) faces += d->facesFound();
+    if (live) cout << "\nLive video at " << reader.fps() << " frames/s, " << nDetectors << " detector threads\n";
+    else cout << "\nVideo, every frame, " << nDetectors << " detector threads\n";
+    printSummary(run, latency, faces);
+    cout << "  dropped       : " << reader.dropped() << " of " << reader.delivered() + reader.dropped() << " frames\n";
+    cout << "  image buffers : " << frames.created() << "\n";
+    threads.print(run.wallTime);
+    cout << "\n";
+    pipeline.report(cout);
+    return run.frames / (run.wallTime / 1e9);
+}
+
+// The run is made in a child process, which reports the throughput back through a pipe.
+double runInChild(function<double()> run)
+{
+    int fds[2];
+    if (pipe(fds) != 0) return 0.0;
+    cout.flush();
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        close(fds[0]);
+        nameThisThread("Main");
+        double framesPerSecond = run();
+        cout.flush();
+        ssize_t written = write(fds[1], &framesPerSecond, sizeof(framesPerSecond));
+        _exit((written == sizeof(framesPerSecond)) ? 0 : 1);
+    }
+    close(fds[1]);
+    double framesPerSecond = 0.0;
+    if ((pid < 0) || (read(fds[0], &framesPerSecond, sizeof(framesPerSecond)) != sizeof(framesPerSecond))) framesPerSecond = 0.0;
+    close(fds[0]);
+    if (pid > 0) waitpid(pid, nullptr, 0);
+    return framesPerSecond;
+}
+
+int main(int argc, char** argv)
+{
+    if ((argc < 2) || (argc > 4))
+    {
+        cout << "\tThis program compares the single thread and the multithread face detection on the same images.\n";
+        cout << "\tIt should be started with the source directory, and optionally the number of times the images\n";
+        cout << "\tare processed and which of the two programs to run:\n";
+        cout << "\n\t\tcascade_classifier_benchmark path/to/your/source/images/ [repeats=5] [single|multi|tiled|all]\n\n";
+        cout << "\twhere tiled is the single thread program with the face detection of each image split in tiles\n";
+        cout << "\tthat are searched in parallel, for faces up to half the shorter side of the image, and the\n";
+        cout << "\teyes of the faces searched in parallel. It is compared with the single thread program that\n";
+        cout << "\tsearches faces up to the same size, which is run before it.\n";
+        cout << "\tThe source directory must contain the haarcascades directory, in the same way as for the\n";
+        cout << "\tother two programs. The images are written to\n";
+        cout << "\n\t\t./your_last_processed_images_benchmark/\n\n";
+        cout << "\tand the frames per second, the latency percentiles of the frames, the peak memory and the\n";
+        cout << "\tCPU time of the process and of each thread are reported.\n\n";
+        cout << "\tA video file instead of the directory is processed by the multithread pipeline, once with every\n";
+        cout << "\tframe and once live, with the frames arriving at the rate of the video:\n";
+        cout << "\n\t\tcascade_classifier_benchmark path/to/your/source/video.avi [1] [multi|live|all]\n\n";
+        cout << "\tThe haarcascades directory is then looked for next to the video.\n\n";
+        return 0;
+    }
+
+    string sourcePath = argv[1];
+    int repeats = (argc > 2) ? stoi(argv[2]) : 5;
+    string variant = (argc > 3) ? argv[3] : "all";
+    string destinationPath = "./your_last_processed_images_benchmark/";
+    if (filesystem::is_regular_file(sourcePath))
+    {
+        if ((variant != "multi") && (variant != "live") && (variant != "all"))
+        {
+            cout << "For a video, the program must be multi, live or all.\n";
+            return -1;
+        }
+        string cascadePath = filesystem::path(sourcePath).parent_path().string() + "/haarcascades/";
+        filesystem::create_directories(destinationPath);
+        string destination = destinationPath + filesystem::path(sourcePath).stem().string() + "_modified.avi";
+        bool failed = false;
+        for (string video : {"multi", "live"})
+        {
+            if ((variant != video) && (variant != "all")) continue;
+            double framesPerSecond = runInChild([&]()
+            {
+                return runVideo(sourcePath, destination, cascadePath + "haarcascade_frontalface_alt.xml",
+                                cascadePath + "haarcascade_eye_tree_eyeglasses.xml", video == "live");
+            });
+            failed = failed || (framesPerSecond == 0.0);
+        }
+        return failed ? -1 : 0;
+    }
+    if ((repeats < 1) || ((variant != "single") && (variant != "multi") && (variant != "tiled") && (variant != "all")))
+    {
+        cout << "The number of repeats must be positive and the program single, multi, tiled or all.\n";
+        return -1;
+    }
+
+    // The images are listed once and the list is repeated, so that the sample is large enough.
+    vector<filesystem::path> images;
+    if (filesystem::is_directory(sourcePath))
+    {
+        for (const filesystem::directory_entry & entry : filesystem::directory_iterator(sourcePath))
+        {
+            if (cv::haveImageReader (entry.path())) images.emplace_back(entry.path());
+        }
+    }
+    if (images.empty())
+    {
+        cout << "No processable files were found. \n";
+        return 0;
+    }
+    filesystem::create_directories(destinationPath);
+    vector<filesystem::path> sourceFiles;
+    vector<filesystem::path> destinationFiles;
+    for (int r = 0; r < repeats; r++)
+    {
+        for (const filesystem::path & p : images)
+        {
+            sourceFiles.emplace_back(p);
+            destinationFiles.emplace_back(filesystem::path(destinationPath + (string) p.stem() + "_modified" + (string) p.extension()));
+        }
+    }
+    for (const filesystem::path & p : images)
+    {
+        ifstream file(p, ios::binary);
+        vector<char> bytes((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    }
+
+    String face_cascade_name = sourcePath+"/haarcascades/haarcascade_frontalface_alt.xml";
+    String eyes_cascade_name = sourcePath+"/haarcascades/haarcascade_eye_tree_eyeglasses.xml";
+
+    cout << images.size() << " images, processed " << repeats << " times, on " << thread::hardware_concurrency()
+         << " cores. OpenCV uses " << cv::getNumThreads() << " threads of its own.\n";
+
+    // The tiles only search faces up to half the shorter side, and are compared with the
+    // single thread program that searches the same faces.
+    const double tiledMaxFace = 0.5;
+    bool failed = false;
+    double single = 0.0;
+    if ((variant == "single") || (variant == "all"))
+    {
+        single = runInChild([&]() { return runSingleThread(sourceFiles, destinationFiles, face_cascade_name, eyes_cascade_name, 0.0, false); });
+        failed = failed || (single == 0.0);
+    }
+    for (string other : {"multi", "tiled"})
+    {
+        if ((variant != other) && (variant != "all")) continue;
+        double baseline = single;
+        if (other == "tiled")
+        {
+            baseline = runInChild([&]() { return runSingleThread(sourceFiles, destinationFiles, face_cascade_name, eyes_cascade_name, tiledMaxFace, false); });
+            failed = failed || (baseline == 0.0);
+        }
+        double framesPerSecond = runInChild([&]()
+        {
+            return (other == "multi") ? runMultiThread(sourceFiles, destinationFiles, face_cascade_name, eyes_cascade_name)
+                                      : runSingleThread(sourceFiles, destinationFiles, face_cascade_name, eyes_cascade_name, tiledMaxFace, true);
+        });
+        failed = failed || (framesPerSecond == 0.0);
+        if ((baseline > 0.0) && (framesPerSecond > 0.0))
+        {
+            cout << "\nThe " << other << " program processes " << fixed << setprecision(2) << framesPerSecond / baseline
+                 << " times as many frames per second as the single thread program"
+                 << ((other == "tiled") ? " with the same maximum face size.\n" : ".\n");
+        }
+    }
+    return failed ? -1 : 0;
+}
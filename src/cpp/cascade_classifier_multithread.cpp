@@ -6,6 +6,9 @@
 
 #include <operator.hpp>
 #include <opsexecuter.hpp>
+#include <replicatedexecuter.hpp>
+#include <pipeline.hpp>
+#include <cvoperators.hpp>
 
 #include <opencv2/opencv.hpp>
 #include <opencv2/imgcodecs.hpp>
@@ -17,102 +20,6 @@ using namespace std;
 using namespace cv;
 using namespace parallelOperators;
 
-CascadeClassifier face_cascade;
-CascadeClassifier eyes_cascade;
-
-
-struct ImageData
-{
-    filesystem::path destinationFile;
-    Mat frame;
-};
-
-class CVFileReaderOp : public SourceOperator<ImageData>
-{
-public:
-    CVFileReaderOp(string opName, vector<filesystem::path> sourceFiles, vector<filesystem::path> destinationFiles) : SourceOperator(opName)
-    {
-        _sourceFiles = sourceFiles;
-        _destinationFiles = destinationFiles;
-        _numberOfFiles = sourceFiles.size();
-    }
-
-private:
-    vector<filesystem::path> _sourceFiles;
-    vector<filesystem::path> _destinationFiles;
-    size_t _numberOfFiles;
-    int _completedFiles {0};
-    ImageData _data;
-    OperationStatus operation() override;
-};
-
-OperationStatus CVFileReaderOp::operation()
-{
-    if (_completedFiles < _numberOfFiles)
-    {
-        _data.frame = imread((string) _sourceFiles[_completedFiles],IMREAD_COLOR);
-        _data.destinationFile = _destinationFiles[_completedFiles];
-        *_output = _data;
-        _completedFiles ++;
-        return OperationStatus::running;
-    }
-    else
-    {
-        return OperationStatus::complete;
-    }
-}
-
-class CVFileWriterOp : public SinkOperator<ImageData>
-{
-public:
-    CVFileWriterOp(string opName) : SinkOperator(opName){};
-
-private:
-    OperationStatus operation() override;
-};
-
-OperationStatus CVFileWriterOp::operation()
-{
-    imwrite(_input->destinationFile, _input->frame);
-    return OperationStatus::running;
-}
-
-class  CVDetector : public Operator<ImageData, ImageData>
-{    
-public:
-    CVDetector(string opName): Operator(opName) {};
-    OperationStatus operation() override;
-private:
-    Mat _frame_gray;
-    vector<Rect> _faces;
-    vector<Rect> _eyes;
-};
-
-OperationStatus CVDetector::operation(){
-    Mat _frame_gray;
-    cvtColor( _input->frame, _frame_gray, COLOR_BGR2GRAY );
-    equalizeHist( _frame_gray, _frame_gray );         
-    //-- Detect faces
-    face_cascade.detectMultiScale( _frame_gray, _faces );
-    for ( size_t i = 0; i < _faces.size(); i++ )
-    {
-        Point center( _faces[i].x + _faces[i].width/2, _faces[i].y + _faces[i].height/2 );
-        ellipse(_input->frame, center, Size( _faces[i].width/2, _faces[i].height/2 ), 0, 0, 360, Scalar( 255, 0, 255 ), 4 );
-        Mat faceROI = _frame_gray( _faces[i] );
-        //-- In each face, detect eyes   
-        eyes_cascade.detectMultiScale( faceROI, _eyes );
-        for ( size_t j = 0; j < _eyes.size(); j++ )
-        {
-            Point eye_center( _faces[i].x + _eyes[j].x + _eyes[j].width/2, _faces[i].y + _eyes[j].y + _eyes[j].height/2 );
-            int radius = cvRound( (_eyes[j].width + _eyes[j].height)*0.25 );
-            circle( _input->frame, eye_center, radius, Scalar( 255, 0, 0 ), 4 );
-        }
-    }
-    _output->frame = _input->frame;
-    _output->destinationFile = _input->destinationFile;
-    return OperationStatus::running;
-};
-
 int main(int argc, char** argv)
 {
     if (argc != 2)
@@ -206,17 +113,32 @@ int main(int argc, char** argv)
     // Load the training data for detection of faces and eyes. 
     String face_cascade_name = sourcePath+"/haarcascades/haarcascade_frontalface_alt.xml";
     String eyes_cascade_name = sourcePath+"/haarcascades/haarcascade_eye_tree_eyeglasses.xml";
+
+    // The face detector is the heavy stage and is replicated on the cores that are left after
+    // the reader and the writer. Every replica has a classifier of its own, built from the
+    // cascade that is parsed only once by the CascadeProvider. The eye detector searches
+    // the faces of each image in parallel, in a pool with one worker per core.
+    unsigned int cores = thread::hardware_concurrency();
+    size_t nDetectors = (cores > 3) ? cores - 2 : 1;
+    vector<unique_ptr<CVFaceDetector>> detectors;
+    WorkStealingPool eyesPool;
+    CVEyeDetector eyes = CVEyeDetector("EyeDetector", eyes_cascade_name);
     //-- 1. Load the cascades
-    if( !face_cascade.load( face_cascade_name ) )
+    for (size_t i = 0; i < nDetectors; i++)
     {
-        cout << "--(!)Error loading face cascade\n";
-        return -1;
-    };
-    if( !eyes_cascade.load( eyes_cascade_name ) )
+        detectors.emplace_back(make_unique<CVFaceDetector>("FaceDetector_" + to_string(i), face_cascade_name));
+        if( !detectors.back()->loaded() )
+        {
+            cout << "--(!)Error loading face cascade\n";
+            return -1;
+        };
+    }
+    if( !eyes.loaded() || !eyes.parallel(eyesPool) )
     {
         cout << "--(!)Error loading eyes cascade\n";
         return -1;
     };
+    cout << nDetectors << " face detector threads will be used.\n";
     cout << "\n\n\nIf you are fine with processing of the file as described above, respond with Yes or yes! \n\n";
 
     cout << ">> ";
@@ -228,51 +150,42 @@ int main(int argc, char** argv)
 
     // Start processing after the final confirmation.
 
-    //1. Create the operators:
+    //1. Create the operators. The images are recycled through a pool, from the writer back to the reader.
     CVFileReaderOp reader = CVFileReaderOp("Op_filieReader", sourceFiles, destinationFiles);
-    CVDetector detector = CVDetector("FaceDetector");
     CVFileWriterOp writer = CVFileWriterOp("Op_filieWriter");
-
-    //2. Create the corresponding threads
-    SourceExecuter<ImageData> readerThread = SourceExecuter<ImageData>("ReaderThread");
-    OperatorExecuter<ImageData,ImageData> detectorThread = OperatorExecuter<ImageData,ImageData>("DetectorThread");
-    SinkExecuter<ImageData> writerThread = SinkExecuter<ImageData>("WriterThread");
-
-    //3. Add the operators to the threads
-    readerThread.addOperator(&reader);
-    detectorThread.addOperator(&detector);
-    writerThread.addOperator(&writer);
-
-    //4. connect the thread inputs and outputs to the operators
-    readerThread.opOutput(reader.outputAddress());
-    detectorThread.opInput(detector.inputAddress());
-    detectorThread.opOutput(detector.outputAddress());
-    writerThread.opInput(writer.inputAddress());
-
-    //5. Connect the threads togetehr
-    detectorThread.input(readerThread.output());
-    writerThread.input(detectorThread.output());
-
-    //6. Set the operation mode
-    readerThread.send(ExecutionMode::Continuous);
-    detectorThread.send(ExecutionMode::Continuous);
-    writerThread.send(ExecutionMode::Continuous);
-
-    //7. Start the threads
-    readerThread.startThread();
-    detectorThread.startThread();
-    writerThread.startThread();
-
-    //8. Wait until all files are read
-    readerThread.waitToEnd();
-
-    //9. Stop the threads one-by-one with delays to make sure that the work is complete
-    readerThread.stop();
-    std::this_thread::sleep_for (std::chrono::milliseconds(500));
-    detectorThread.stop();
-    detectorThread.waitToEnd();
-    std::this_thread::sleep_for (std::chrono::milliseconds(500));
-    writerThread.stop();
-    writerThread.waitToEnd();
+    FramePool frames;
+    reader.pool(&frames);
+    reader.prefetch(8, 256 << 20);
+    for (auto & detector : detectors) detector->pool(&frames);
+    eyes.pool(&frames);
+    writer.pool(&frames);
+    // The images are encoded in the same pool as the eyes, in the order they were read.
+    writer.encoders(eyesPool);
+
+    //2. Build the pipeline from the operators. It creates an executer with its own thread for
+    //   each stage, connects them with buffers and owns them. The face detector is replicated,
+    //   with one replica for each detector.
+    vector<CVFaceDetector *> faceDetectors;
+    for (auto & detector : detectors) faceDetectors.emplace_back(detector.get());
+    Pipeline pipeline("FaceDetection");
+    pipeline.source(reader)
+            .stage("DetectorThread", faceDetectors)
+            .stage(eyes)
+            .sink(writer);
+
+    //3. Start the threads in continuous mode
+    pipeline.start();
+
+    //4. The reader ends the stream after the last file. Wait until the last file is written.
+    pipeline.drain();
+    writer.flush();
+
+    //5. Show where the time went, in microseconds per frame.
+    cout << "\n";
+    pipeline.report(cout);
+    cout << frames.created() << " image buffers were allocated for " << sourceFiles.size() << " files.\n";
+
+    //6. When built with PIPELINE_TRACE, save the timeline to be opened in Perfetto.
+    TRACE_DUMP("pipeline_trace.json");
 }
 
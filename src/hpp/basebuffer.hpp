@@ -0,0 +1,130 @@
+/**************************************************************************************
+ * Base buffer is the common interface of all buffers that can be placed between two
+ * Executers. The Executers only need to send and receive data through swapping of
+ * unique pointers and to be able to release waiting threads at the end. How the data
+ * is stored and how the two threads are synchronized is left to the child classes.
+ *
+ * Having the same base class allows the Executers to be connected with different kinds
+ * of buffers, e.g. the one-slot UniqueBuffer or the multi-slot RingBuffer, without
+ * any change in the Executers or the operators.
+ *
+ * The base class also keeps the wait policies of the two sides, so that the sending and
+ * the receiving thread can choose how they wait, independent of each other.
+ *
+ * For Executers that run as tasks in a thread pool instead of in their own threads,
+ * there are non-blocking versions of send and receive, and listeners that are called
+ * when new data has arrived or when space has become free. With these, a task can leave
+ * the worker thread when it would otherwise block and be scheduled again when it can
+ * continue.
+ *
+ * The producer ends a stream by closing the buffer after its last item. The items that
+ * are already in the buffer are still delivered, and after them, receive returns false
+ * instead of waiting. This allows the end of a stream to travel through a pipeline behind
+ * the last real item, so that every Executer can finish its work before it ends.
+ *
+ * **************************************************************************************/
+#pragma once
+
+#include <memory>
+#include <string>
+#include <functional>
+
+#include <waitpolicy.hpp>
+#include <tracer.hpp>
+
+using namespace std;
+
+namespace parallelOperators
+{
+    template <class T>
+    class BaseBuffer
+    {
+    public:
+        BaseBuffer(string bname): _bname (bname)
+        {
+#ifdef PIPELINE_TRACE
+            _traceReceive = TRACE_INTERN(bname + " receive");
+            _traceSend = TRACE_INTERN(bname + " send");
+#endif
+        };
+        virtual ~BaseBuffer() {};
+
+        // Receive waits for new data and swaps it with the content of data_ptr. False is
+        // returned without any data when the stream has ended or the buffer is released.
+        virtual bool receive(unique_ptr<T> & data_ptr) = 0;
+
+        // Send waits for free space and swaps the content of data_ptr into the buffer.
+        virtual void send(unique_ptr<T> & data_ptr) = 0;
+
+        // Non-blocking versions of receive and send. They return false instead of waiting.
+        virtual bool tryReceive(unique_ptr<T> & data_ptr) = 0;
+        virtual bool trySend(unique_ptr<T> & data_ptr) = 0;
+
+        // Called by the producer after its last item to end the stream.
+        virtual void close() = 0;
+
+        // True when the stream is closed and all items have been received.
+        virtual bool endOfStream() = 0;
+
+        // When an ending request has come, all waiting threads need to be released.
+        virtual void releaseAll() = 0;
+
+        // Allocates the storage of the free slots again in the calling thread, so that it is
+        // placed on the NUMA node of that thread. Called by the producer before its first send.
+        virtual void allocateSlots() {};
+
+        // Listeners to be called when data has arrived, for the consumer, and when space has
+        // become free, for the producer. Should be set before the data exchange starts.
+        void onData(function<void()> listener)
+        {
+            _dataListener = listener;
+        };
+        void onSpace(function<void()> listener)
+        {
+            _spaceListener = listener;
+        };
+
+        // Selection of how the sending and the receiving threads wait. Should be set before
+        // the threads start.
+        void waitPolicy(WaitPolicy policy)
+        {
+            _sendPolicy = policy;
+            _receivePolicy = policy;
+        };
+        void sendPolicy(WaitPolicy policy)
+        {
+            _sendPolicy = policy;
+        };
+        void receivePolicy(WaitPolicy policy)
+        {
+            _receivePolicy = policy;
+        };
+
+    protected:
+        string _bname;                              // A name to allow following the process
+        WaitPolicy _sendPolicy = WaitPolicy::Block;         // How send waits for free space
+        WaitPolicy _receivePolicy = WaitPolicy::Block;      // How receive waits for new data
+        function<void()> _dataListener;             // Called after new data has arrived
+        function<void()> _spaceListener;            // Called after space has become free
+
+#ifdef PIPELINE_TRACE
+    public:
+        // Names of the waits in the trace, see tracer.hpp.
+        const char * traceReceive() const { return _traceReceive; };
+        const char * traceSend() const { return _traceSend; };
+    protected:
+        const char * _traceReceive;
+        const char * _traceSend;
+#endif
+
+        // To be called by the child classes, without holding any lock.
+        void _notifyData()
+        {
+            if (_dataListener) _dataListener();
+        };
+        void _notifySpace()
+        {
+            if (_spaceListener) _spaceListener();
+        };
+    };
+}
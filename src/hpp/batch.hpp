@@ -0,0 +1,137 @@
+/*************************************************************************************
+ * Batches let small items pass through a pipeline N at a time. Every hand-off between two
+ * Executers costs a lock, or at least a few atomic operations and cache misses, and for an
+ * int or a float this is much more than the work of the operators. When an Executer works
+ * on a Batch<T, N> instead of a T, the buffers hand over up to N items with one swap, and
+ * the Executer calls its operators once per batch, so these costs are shared by N items.
+ *
+ * A batch is an item like any other, so every buffer, e.g. the Unique, Ring or SPSC
+ * buffer, carries batches without any change, still without copying the items.
+ *
+ * There are two ways to write an operator for batches:
+ *
+ *      1. BatchOperator<T_IN, T_OUT, N>, with an operation() over the items of a batch:
+ *              OperationStatus operation(T_IN * inputs, T_OUT * outputs, size_t count)
+ *      2. Batched<Op, N>, BatchedSource<Op, N> and BatchedSink<Op, N>, which run an
+ *          existing operator for one item on each item of the batch. The operator is called
+ *          with its qualified name, so that there is no virtual dispatch per item, as in
+ *          the FusedChain:
+ *
+ *              Batched<Add5, 64> add("add_5_batched", add5);
+ *              pipeline.source(source).stage(add).sink(sink);
+ *
+ * A batched source fills a batch before it is sent, and stops at the item with which the
+ * source reports that it is complete, so the last batch may be smaller than N. Since the
+ * first item of a batch waits for the last one, batches are meant for small items that
+ * arrive at a high rate, not for items that each take a long time to produce, as the
+ * frames of a camera.
+ *
+*************************************************************************************/
+#pragma once
+
+#include <array>
+#include <string>
+
+#include <operator.hpp>
+
+using namespace std;
+
+namespace parallelOperators
+{
+    // Up to N items, passed on together.
+    template <class T, size_t N>
+    struct Batch
+    {
+        static_assert(N > 0, "A batch needs at least one item.");
+        array<T, N> items {};
+        size_t size {0};                    // Number of valid items, from the first
+    };
+
+    // An operator that works on the items of a batch, one batch per call.
+    template <class T_IN, class T_OUT, size_t N>
+    class BatchOperator : public Operator<Batch<T_IN, N>, Batch<T_OUT, N>>
+    {
+    public:
+        BatchOperator(string opName) : Operator<Batch<T_IN, N>, Batch<T_OUT, N>>(opName) {};
+
+        OperationStatus operation() override
+        {
+            this->_output->size = this->_input->size;
+            return operation(this->_input->items.data(), this->_output->items.data(), this->_input->size);
+        };
+
+        // The count items of one batch, in order. Complete if the operator is complete
+        // with any of them.
+        virtual OperationStatus operation(T_IN * inputs, T_OUT * outputs, size_t count) = 0;
+    };
+
+    // An existing operator, applied to each item of a batch.
+    template <class Op, size_t N>
+    class Batched : public BatchOperator<typename Op::input_type, typename Op::output_type, N>
+    {
+    public:
+        using BatchOperator<typename Op::input_type, typename Op::output_type, N>::operation;
+
+        Batched(string opName, Op & op): BatchOperator<typename Op::input_type, typename Op::output_type, N>(opName), _op(op) {};
+
+        OperationStatus operation(typename Op::input_type * inputs, typename Op::output_type * outputs, size_t count) override
+        {
+            OperationStatus status = OperationStatus::running;
+            for (size_t i = 0; i < count; i++)
+            {
+                _op.input(&inputs[i]);
+                _op.output(&outputs[i]);
+                if (_op.Op::operation() == OperationStatus::complete) status = OperationStatus::complete;
+            }
+            return status;
+        };
+
+    private:
+        Op & _op;
+    };
+
+    // An existing source, called until a batch is full or the source is complete.
+    template <class Op, size_t N>
+    class BatchedSource : public SourceOperator<Batch<typename Op::output_type, N>>
+    {
+    public:
+        BatchedSource(string opName, Op & op): SourceOperator<Batch<typename Op::output_type, N>>(opName), _op(op) {};
+
+        OperationStatus operation() override
+        {
+            OperationStatus status = OperationStatus::running;
+            size_t & size = this->_output->size;
+            for (size = 0; (size < N) && (status != OperationStatus::complete); size++)
+            {
+                _op.output(&this->_output->items[size]);
+                status = _op.Op::operation();
+            }
+            return status;
+        };
+
+    private:
+        Op & _op;
+    };
+
+    // An existing sink, given each item of a batch in order.
+    template <class Op, size_t N>
+    class BatchedSink : public SinkOperator<Batch<typename Op::input_type, N>>
+    {
+    public:
+        BatchedSink(string opName, Op & op): SinkOperator<Batch<typename Op::input_type, N>>(opName), _op(op) {};
+
+        OperationStatus operation() override
+        {
+            OperationStatus status = OperationStatus::running;
+            for (size_t i = 0; i < this->_input->size; i++)
+            {
+                _op.input(&this->_input->items[i]);
+                if (_op.Op::operation() == OperationStatus::complete) status = OperationStatus::complete;
+            }
+            return status;
+        };
+
+    private:
+        Op & _op;
+    };
+}
@@ -0,0 +1,83 @@
+/*************************************************************************************
+ * A buffer pool keeps buffers that are no longer in use, so that they can be used again
+ * for the next item instead of being freed and allocated. Buffers are kept by a key,
+ * e.g. the size and type of an image, and only a buffer with the same key is handed out:
+ *
+ *      BufferPool<vector<uint8_t>, size_t> pool([](const size_t & size) { return vector<uint8_t>(size); });
+ *      vector<uint8_t> buffer = pool.acquire(1024);
+ *      ...
+ *      pool.release(1024, move(buffer));
+ *
+ * A new buffer is only created when there is no free buffer with the key. When the items
+ * are of the same kind, the pool holds as many buffers as there are items in flight after
+ * the first few items, and no more buffers are created after that.
+ *
+ * The buffers are moved in and out of the pool, and the buffers may be acquired in one
+ * thread and released in another, e.g. acquired by the source and released by the sink.
+ *
+*************************************************************************************/
+#pragma once
+
+#include <map>
+#include <vector>
+#include <functional>
+#include <mutex>
+
+#include <atomic>
+
+using namespace std;
+
+namespace parallelOperators
+{
+    template <class T, class Key>
+    class BufferPool
+    {
+    public:
+        BufferPool(function<T(const Key &)> create): _create(move(create)) {};
+
+        // A free buffer with the key, or a new one if there is none.
+        T acquire(const Key & key)
+        {
+            {
+                lock_guard<mutex> uLock(_mutex);
+                auto found = _free.find(key);
+                if ((found != _free.end()) && !found->second.empty())
+                {
+                    T buffer = move(found->second.back());
+                    found->second.pop_back();
+                    return buffer;
+                }
+            }
+            _created++;
+            return _create(key);
+        };
+
+        // The buffer is kept for the next acquire() with the same key.
+        void release(const Key & key, T && buffer)
+        {
+            lock_guard<mutex> uLock(_mutex);
+            _free[key].emplace_back(move(buffer));
+        };
+
+        // Number of buffers created by the pool since it was constructed.
+        size_t created() const
+        {
+            return _created.load();
+        };
+
+        // Number of buffers that are waiting in the pool.
+        size_t free()
+        {
+            lock_guard<mutex> uLock(_mutex);
+            size_t count = 0;
+            for (auto & list : _free) count += list.second.size();
+            return count;
+        };
+
+    private:
+        function<T(const Key &)> _create;           // Creates a new buffer for a key
+        mutex _mutex;                               // Protects the free buffers
+        map<Key, vector<T>> _free;                  // Free buffers, by key
+        atomic<size_t> _created {0};
+    };
+}
@@ -0,0 +1,65 @@
+/*************************************************************************************
+ * A CascadeClassifier must not be used by several threads at the same time, so every
+ * detector, every replica of a detector and every thread that searches tiles or faces
+ * needs a classifier of its own. Loading each of them from the file would read and parse
+ * the same XML file, tens of thousands of lines, once per thread.
+ *
+ * The provider parses each file once and keeps the parsed model. Every call of
+ * classifier() builds a new, independent classifier from the parsed model:
+ *
+ *      unique_ptr<CascadeClassifier> cascade = CascadeProvider::instance().classifier(fileName);
+ *
+ * The provider is shared by all threads and the calls are serialized, since they are made
+ * at set up and not for every image. A null pointer is returned if the file cannot be
+ * read or is not a cascade.
+ *
+*************************************************************************************/
+#pragma once
+
+#include <string>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include <opencv2/opencv.hpp>
+#include "opencv2/objdetect.hpp"
+
+using namespace std;
+using namespace cv;
+
+class CascadeProvider
+{
+public:
+    static CascadeProvider & instance()
+    {
+        static CascadeProvider provider;
+        return provider;
+    };
+
+    unique_ptr<CascadeClassifier> classifier(const String & fileName)
+    {
+        lock_guard<mutex> uLock(_mutex);
+        auto model = _models.find(fileName);
+        if (model == _models.end())
+        {
+            model = _models.emplace(fileName, make_unique<FileStorage>(fileName, FileStorage::READ)).first;
+        }
+        if (!model->second->isOpened()) return nullptr;
+        auto cascade = make_unique<CascadeClassifier>();
+        if (!cascade->read(model->second->getFirstTopLevelNode())) return nullptr;
+        return cascade;
+    };
+
+    // Number of files that have been parsed so far.
+    size_t parsedFiles()
+    {
+        lock_guard<mutex> uLock(_mutex);
+        return _models.size();
+    };
+
+private:
+    CascadeProvider() {};
+
+    mutex _mutex;                                   // Protects the models and the reading from them
+    map<String, unique_ptr<FileStorage>> _models;   // The parsed files, kept open for the next classifier
+};
@@ -0,0 +1,144 @@
+/**************************************************************************************
+ * Conflating Buffer is a one-slot buffer for real-time stages, where the newest item is
+ * worth more than all the others, e.g. the frames of a camera. It differs from the Unique
+ * Buffer only in what happens when the consumer has not yet taken the previous item:
+ *
+ *      Unique Buffer: send waits until the consumer has taken the previous item.
+ *      Conflating Buffer: send never waits. The new item replaces the unread one, and the
+ *          unread item is swapped back to the producer, which reuses it for its next item.
+ *
+ * The consumer therefore always receives the newest item, and an item is never older than
+ * one item of the producer plus the time of the consumer, however slow the consumer is.
+ * The items that were replaced before they were read are counted, see dropped().
+ *
+ * As in the Unique Buffer, the delivery of data is only exchange of addresses. A dropped
+ * item is not freed but goes back to the producer, so nothing is allocated either.
+ *
+ * close() does not replace anything, so the last item that was sent before the end of
+ * the stream is always delivered.
+ *
+ * **************************************************************************************/
+#pragma once
+
+#include <mutex>
+#include <condition_variable>
+
+#include <atomic>
+
+#include <iostream>
+
+#include <basebuffer.hpp>
+
+using namespace std;
+
+namespace parallelOperators
+{
+    template <class T>
+    class ConflatingBuffer : public BaseBuffer<T>
+    {
+    public:
+        ConflatingBuffer(string bname): BaseBuffer<T>(bname), _buffer(make_unique<T>()) {};
+
+        bool receive(unique_ptr<T> & data_ptr) override
+        {
+#ifdef DEBUG_PRINTOUT
+            cout << " **) Waiting for refreshed data from - " << _bname << "   \n";
+#endif
+            spinWait(_receivePolicy, [this] { return (_dataRefreshed || _ending || _closed); });
+            unique_lock<mutex> uLock(_mutex);
+            _condition.wait(uLock, [this] { return (_dataRefreshed || _ending || _closed); });
+            if (!_dataRefreshed) return false;      // End of stream, or released
+            _buffer.swap(data_ptr);
+            _dataRefreshed = false;
+            uLock.unlock();
+            this->_notifySpace();
+            return true;
+        };
+
+        // Never waits. If the previous item has not been read, it is returned in data_ptr.
+        void send(unique_ptr<T> & data_ptr) override
+        {
+            unique_lock<mutex> uLock(_mutex);
+            if (_ending) return;
+            if (_dataRefreshed) _dropped++;
+#ifdef DEBUG_PRINTOUT
+            if (_dataRefreshed) cout << " **) Unread data is replaced at - " << _bname << "   \n";
+#endif
+            _buffer.swap(data_ptr);
+            _dataRefreshed = true;
+            _condition.notify_one();
+            uLock.unlock();
+            this->_notifyData();
+        };
+
+        bool tryReceive(unique_ptr<T> & data_ptr) override
+        {
+            unique_lock<mutex> uLock(_mutex);
+            if (!_dataRefreshed) return false;
+            _buffer.swap(data_ptr);
+            _dataRefreshed = false;
+            uLock.unlock();
+            this->_notifySpace();
+            return true;
+        };
+        bool trySend(unique_ptr<T> & data_ptr) override
+        {
+            send(data_ptr);
+            return true;
+        };
+
+        void close() override
+        {
+#ifdef DEBUG_PRINTOUT
+            cout << " **) End of stream - " << _bname << "   \n";
+#endif
+            {
+                lock_guard<mutex> uLock(_mutex);
+                _closed = true;
+                _condition.notify_all();
+            }
+            this->_notifyData();
+        };
+        bool endOfStream() override
+        {
+            return (_closed && !_dataRefreshed);
+        };
+
+        void releaseAll() override
+        {
+#ifdef DEBUG_PRINTOUT
+            cout << " **) Request to end and release mutex - " << _bname << "   \n";
+#endif
+            {
+                lock_guard<mutex> uLock(_mutex);
+                _ending = true;
+                _condition.notify_all();
+            }
+            this->_notifyData();
+            this->_notifySpace();
+        };
+
+        void allocateSlots() override
+        {
+            lock_guard<mutex> uLock(_mutex);
+            if (!_dataRefreshed) _buffer = make_unique<T>();
+        };
+
+        // Number of items that were replaced before the consumer read them.
+        size_t dropped() const
+        {
+            return _dropped.load();
+        };
+
+    private:
+        using BaseBuffer<T>::_bname;
+        using BaseBuffer<T>::_receivePolicy;
+        mutex _mutex;                               // Data protection
+        condition_variable _condition;              // The consumer waits for new data
+        unique_ptr<T> _buffer;                      // Data storage
+        atomic_bool _dataRefreshed = false;         // The buffer holds an item that has not been read
+        atomic_bool _ending = false;
+        atomic_bool _closed = false;                // The producer has sent its last item
+        atomic<size_t> _dropped {0};
+    };
+}
@@ -0,0 +1,579 @@
+/*************************************************************************************
+ * The operators of the face detection demo, shared by the multithread program and the
+ * benchmark that compares it with the single thread program:
+ *
+ *      1. CVFileReaderOp reads the images one by one and ends the stream after the last one.
+ *      2. CVFaceDetector finds the faces in the image.
+ *      3. CVEyeDetector finds the eyes in each face and draws the faces and the eyes.
+ *      4. CVFileWriterOp writes the images to their destination.
+ *
+ * Every image carries the time it was read, so that the writer can record the latency of
+ * each frame through the whole pipeline.
+ *
+ * A large image keeps one detector busy for a long time, while the other cores wait. The
+ * detector can therefore split the face detection of one image over a pool, see tiled():
+ *
+ *      1. The image is cut in a grid of tiles, with up to one tile per thread that takes
+ *          part. Of the grids with that many tiles, the one with the smallest tiles is
+ *          taken, so that the time of one image goes down with the number of threads.
+ *      2. Each tile is extended by half the largest face on every side, so that every
+ *          face up to that size with its center in the tile lies completely inside it.
+ *      3. The tiles are searched in parallel, each with a classifier of its own.
+ *      4. A face in an overlap is found in two tiles, and only the tile that holds its
+ *          center keeps it.
+ *
+ * The largest face is given as a fraction of the shorter side of the image, and the same
+ * limit can be used for the whole image, which gives the same faces as the tiles.
+ *
+ * In the same way, a group photo with many faces would keep the eye detection busy for a
+ * long time, face after face. The eye detector can search the faces in parallel, see
+ * parallel(). The faces and eyes are drawn afterwards, in the thread of the operator.
+ *
+ * When the operators share a FramePool, see pool(), the images are not allocated for
+ * every file. The reader decodes a file it has decoded before into a frame of its size
+ * from the pool, the face detector takes the gray image from the pool, and the frames are
+ * moved from stage to stage. The eye detector returns the gray image and the writer returns
+ * the frame to the pool, so that when the files are read again, e.g. by the benchmark,
+ * images of the same size and type reuse the same memory.
+ *
+ * With prefetch(), the reader reads the next files in the background with a FilePrefetcher
+ * and decodes each image from memory, so that the time waiting for the disk is hidden
+ * behind the detection of the images before it.
+ *
+ * At the other end, the writer can hand the frames to a pool of encoders, see encoders(),
+ * when encoding large images takes longer than detecting the faces in them. The files
+ * can still be written in the order of the frames.
+ *
+*************************************************************************************/
+#pragma once
+
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <fstream>
+#include <tuple>
+#include <map>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+#include <atomic>
+#include <cstdint>
+
+#include <operator.hpp>
+#include <metrics.hpp>
+#include <threadpool.hpp>
+#include <cascadeprovider.hpp>
+#include <bufferpool.hpp>
+#include <fileprefetcher.hpp>
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include "opencv2/objdetect.hpp"
+
+using namespace std;
+using namespace cv;
+using namespace parallelOperators;
+
+
+struct ImageData
+{
+    filesystem::path destinationFile;
+    Mat frame;
+    MetricsClock::time_point readTime;      // When the reading of the image started
+    Mat gray;                               // Equalized gray image, for the detectors
+    vector<Rect> faces;                     // Faces found in the image
+};
+
+// A copy of a Mat shares its pixels, so that the branches of a FanOutExecuter would draw in
+// the same image. Each branch gets images of its own instead, and copyTo() reuses the
+// memory of the branch when the size is the same.
+inline void copyItem(ImageData & destination, const ImageData & source)
+{
+    destination.destinationFile = source.destinationFile;
+    source.frame.copyTo(destination.frame);
+    destination.readTime = source.readTime;
+    source.gray.copyTo(destination.gray);
+    destination.faces = source.faces;
+}
+
+// Images of the same rows, columns and type share their memory.
+class FramePool
+{
+public:
+    FramePool(): _pool([](const tuple<int, int, int> & key)
+        { return Mat(get<0>(key), get<1>(key), get<2>(key)); }) {};
+
+    Mat acquire(Size size, int type)
+    {
+        return _pool.acquire(make_tuple(size.height, size.width, type));
+    };
+
+    // The frame is left empty.
+    void release(Mat & frame)
+    {
+        if (frame.empty()) return;
+        _pool.release(make_tuple(frame.rows, frame.cols, frame.type()), move(frame));
+        frame.release();
+    };
+
+    size_t created() const { return _pool.created(); };
+
+private:
+    BufferPool<Mat, tuple<int, int, int>> _pool;
+};
+
+class CVFileReaderOp : public SourceOperator<ImageData>
+{
+public:
+    CVFileReaderOp(string opName, vector<filesystem::path> sourceFiles, vector<filesystem::path> destinationFiles) : SourceOperator(opName)
+    {
+        _sourceFiles = sourceFiles;
+        _destinationFiles = destinationFiles;
+        _numberOfFiles = sourceFiles.size();
+    }
+    OperationStatus operation() override;
+
+    // If given, the images are decoded into frames from the pool.
+    void pool(FramePool * frames) { _frames = frames; };
+
+    // Reads up to depth files, and at most budgetBytes, ahead in a thread of its own.
+    void prefetch(size_t depth, size_t budgetBytes)
+    {
+        _prefetcher = make_unique<FilePrefetcher>(_sourceFiles, depth, budgetBytes);
+    };
+
+private:
+    vector<filesystem::path> _sourceFiles;
+    vector<filesystem::path> _destinationFiles;
+    size_t _numberOfFiles;
+    size_t _completedFiles {0};
+    FramePool * _frames = nullptr;
+    unique_ptr<FilePrefetcher> _prefetcher;     // Set by prefetch()
+    vector<uchar> _fileBuffer;                  // Encoded file, reused for every file
+    map<filesystem::path, Size> _sizes;         // Size of each file, known after its first decode
+    void _readFrame(const filesystem::path & file);
+};
+
+// A file that was decoded before, e.g. when the files are read again, is decoded into a
+// frame of its size from the pool, and imdecode() does not allocate. The first time, the
+// size is not known, and imdecode() allocates the frame, which the writer returns to the pool.
+inline void CVFileReaderOp::_readFrame(const filesystem::path & file)
+{
+    if ((_frames == nullptr) && (_prefetcher == nullptr))
+    {
+        _output->frame = imread((string) file, IMREAD_COLOR);
+        return;
+    }
+    if (_prefetcher != nullptr)
+    {
+        _prefetcher->next(_fileBuffer);
+    }
+    else
+    {
+        ifstream stream(file, ios::binary | ios::ate);
+        _fileBuffer.resize(stream ? (size_t) stream.tellg() : 0);
+        stream.seekg(0);
+        stream.read((char *) _fileBuffer.data(), _fileBuffer.size());
+    }
+    if (_fileBuffer.empty())
+    {
+        _output->frame.release();
+        return;
+    }
+    auto known = _sizes.find(file);
+    if ((_frames != nullptr) && (known != _sizes.end())) _output->frame = _frames->acquire(known->second, CV_8UC3);
+    else if (_frames != nullptr) _output->frame.release();
+    imdecode(_fileBuffer, IMREAD_COLOR, &_output->frame);
+    if ((known == _sizes.end()) && !_output->frame.empty()) _sizes.emplace(file, _output->frame.size());
+}
+
+// The last file is delivered together with the complete status, so that the stream ends
+// right behind it and no frame is sent twice.
+inline OperationStatus CVFileReaderOp::operation()
+{
+    if (_completedFiles < _numberOfFiles)
+    {
+        _output->readTime = MetricsClock::now();
+        _readFrame(_sourceFiles[_completedFiles]);
+        _output->destinationFile = _destinationFiles[_completedFiles];
+        _completedFiles ++;
+    }
+    return (_completedFiles < _numberOfFiles) ? OperationStatus::running : OperationStatus::complete;
+}
+
+// The writer encodes and writes each frame in its own thread, or hands it to a pool of
+// encoders, see encoders(). The frames that are being encoded are held by the writer, and
+// the writer waits when all of them are in use, so that a slow disk holds up the pipeline
+// instead of filling the memory.
+class CVFileWriterOp : public SinkOperator<ImageData>
+{
+public:
+    CVFileWriterOp(string opName) : SinkOperator(opName){};
+    ~CVFileWriterOp() { flush(); };
+    OperationStatus operation() override;
+
+    // If given, the time from reading to the end of writing is recorded for each frame.
+    void latency(LatencyHistogram * histogram) { _latency = histogram; };
+
+    // If given, the written frames are returned to the pool.
+    void pool(FramePool * frames) { _frames = frames; };
+
+    // JPEG quality from 0 to 100, and PNG compression from 0 to 9. A higher compression
+    // gives smaller files and takes more time.
+    void quality(int jpegQuality, int pngCompression)
+    {
+        _parameters = {IMWRITE_JPEG_QUALITY, jpegQuality, IMWRITE_PNG_COMPRESSION, pngCompression};
+    };
+
+    // Encodes the frames in the pool, with up to inFlight frames at the same time, one per
+    // thread of the pool if 0. Each frame is encoded into a buffer that is used again for
+    // a later frame and written with one call. With ordered, the files are written in the
+    // order the frames arrived, otherwise as soon as they are encoded.
+    void encoders(WorkStealingPool & pool, bool ordered = true, size_t inFlight = 0)
+    {
+        flush();
+        _pool = &pool;
+        _ordered = ordered;
+        _nextWrite = _nextSequence;
+        _jobs = vector<EncodeJob>((inFlight > 0) ? inFlight : pool.workers() + 1);
+        _freeJobs.clear();
+        for (size_t i = 0; i < _jobs.size(); i++) _freeJobs.push_back(i);
+    };
+
+    // Waits until all frames handed to the encoders are written. Called after the end of the
+    // stream, before the files are used.
+    void flush()
+    {
+        unique_lock<mutex> uLock(_mutex);
+        _condition.wait(uLock, [this] { return (_freeJobs.size() == _jobs.size()); });
+    };
+
+private:
+    struct EncodeJob
+    {
+        ImageData data;
+        vector<uchar> bytes;                    // Encoded file, reused for later frames
+        size_t sequence {0};
+    };
+
+    LatencyHistogram * _latency = nullptr;
+    FramePool * _frames = nullptr;
+    vector<int> _parameters;                    // Passed to imwrite() and imencode()
+    WorkStealingPool * _pool = nullptr;         // Set by encoders()
+    bool _ordered {true};
+    vector<EncodeJob> _jobs;
+    mutex _mutex;                               // Protects the members below
+    condition_variable _condition;
+    deque<size_t> _freeJobs;                    // Jobs that can take the next frame
+    map<size_t, size_t> _encoded;               // Jobs encoded and waiting for their turn, by sequence
+    size_t _nextSequence {0};                   // Given to the next frame
+    size_t _nextWrite {0};                      // Sequence of the next file to write, when ordered
+    bool _writing {false};                      // A thread is writing the encoded files in order
+
+    void _done(ImageData & data);
+    void _encode(size_t job);
+    void _write(EncodeJob & job);
+};
+
+inline void CVFileWriterOp::_done(ImageData & data)
+{
+    if (_latency != nullptr) _latency->record(elapsedNanoseconds(data.readTime, MetricsClock::now()));
+    if (_frames != nullptr) _frames->release(data.frame);
+    else data.frame.release();
+}
+
+inline void CVFileWriterOp::_write(EncodeJob & job)
+{
+    if (!job.bytes.empty())
+    {
+        ofstream file(job.data.destinationFile, ios::binary);
+        file.write((const char *) job.bytes.data(), job.bytes.size());
+    }
+    _done(job.data);
+}
+
+// Runs in the pool. When ordered, the thread that finds the next file encoded writes it and
+// every file after it that is ready, while the other threads go on encoding.
+inline void CVFileWriterOp::_encode(size_t index)
+{
+    EncodeJob & job = _jobs[index];
+    if (!imencode(job.data.destinationFile.extension().string(), job.data.frame, job.bytes, _parameters)) job.bytes.clear();
+    unique_lock<mutex> uLock(_mutex);
+    if (!_ordered)
+    {
+        uLock.unlock();
+        _write(job);
+        uLock.lock();
+        _freeJobs.push_back(index);
+        _condition.notify_all();
+        return;
+    }
+    _encoded[job.sequence] = index;
+    if (_writing) return;
+    _writing = true;
+    while (!_encoded.empty() && (_encoded.begin()->first == _nextWrite))
+    {
+        size_t next = _encoded.begin()->second;
+        _encoded.erase(_encoded.begin());
+        uLock.unlock();
+        _write(_jobs[next]);
+        uLock.lock();
+        _nextWrite++;
+        _freeJobs.push_back(next);
+        _condition.notify_all();
+    }
+    _writing = false;
+}
+
+inline OperationStatus CVFileWriterOp::operation()
+{
+    if (_input->frame.empty()) return OperationStatus::running;
+    if (_pool == nullptr)
+    {
+        imwrite(_input->destinationFile, _input->frame, _parameters);
+        _done(*_input);
+        return OperationStatus::running;
+    }
+    size_t index;
+    {
+        unique_lock<mutex> uLock(_mutex);
+        _condition.wait(uLock, [this] { return !_freeJobs.empty(); });
+        index = _freeJobs.front();
+        _freeJobs.pop_front();
+    }
+    EncodeJob & job = _jobs[index];
+    swap(job.data.frame, _input->frame);
+    job.data.destinationFile = _input->destinationFile;
+    job.data.readTime = _input->readTime;
+    job.sequence = _nextSequence++;
+    _pool->submit([this, index] { _encode(index); });
+    return OperationStatus::running;
+}
+
+// Each detector has its own classifiers, since a classifier must not be used by several
+// threads at the same time. This allows running several detectors in parallel. The
+// classifiers are built from the models parsed once by the CascadeProvider.
+class  CVFaceDetector : public Operator<ImageData, ImageData>
+{
+public:
+    CVFaceDetector(string opName, String faceCascadeName): Operator(opName), _faceCascadeName(faceCascadeName)
+    {
+        _faceCascade = CascadeProvider::instance().classifier(faceCascadeName);
+        _loaded = (_faceCascade != nullptr);
+    };
+    OperationStatus operation() override;
+    bool loaded() { return _loaded; };
+    size_t facesFound() { return _facesFound; };        // In all images so far
+
+    // Faces larger than the given fraction of the shorter side of the image are not searched
+    // for. A fraction of 0 or 1 and above searches for faces of all sizes.
+    void maxFaceFraction(double fraction) { _maxFaceFraction = fraction; };
+
+    // Splits the face detection over the pool, for faces up to the maximum size given above.
+    // Without a maximum size, or when the tiles would be as large as the image, the whole
+    // image is searched in the calling thread. False is returned if the classifiers of the tiles cannot be loaded.
+    bool tiled(WorkStealingPool & pool)
+    {
+        _pool = &pool;
+        _tileCascades.clear();
+        for (size_t i = 0; i <= pool.workers(); i++)
+        {
+            _tileCascades.emplace_back(CascadeProvider::instance().classifier(_faceCascadeName));
+            if (_tileCascades.back() == nullptr) return false;
+        }
+        return true;
+    };
+
+    // If given, the gray images are taken from the pool.
+    void pool(FramePool * frames) { _frames = frames; };
+
+private:
+    String _faceCascadeName;
+    unique_ptr<CascadeClassifier> _faceCascade;
+    bool _loaded;
+    vector<Rect> _faces;
+    size_t _facesFound {0};
+    double _maxFaceFraction {0.0};                  // Largest face, relative to the shorter side
+    WorkStealingPool * _pool = nullptr;             // Set in tiled mode
+    vector<unique_ptr<CascadeClassifier>> _tileCascades;    // One per tile, used by one thread at a time
+    vector<Rect> _tiles;                            // Searched by the threads, with the overlaps
+    vector<Rect> _cores;                            // The same tiles without the overlaps
+    vector<vector<Rect>> _tileFaces;
+    FramePool * _frames = nullptr;
+
+    void _detectFaces(const Mat & gray);
+    Size _maxFaceSize(Size frame);
+};
+
+inline Size CVFaceDetector::_maxFaceSize(Size frame)
+{
+    if ((_maxFaceFraction <= 0.0) || (_maxFaceFraction >= 1.0)) return Size();
+    int side = (int) (_maxFaceFraction * min(frame.width, frame.height));
+    return Size(side, side);
+}
+
+inline void CVFaceDetector::_detectFaces(const Mat & gray)
+{
+    Size frame = gray.size();
+    Size maxFace = _maxFaceSize(frame);
+    int margin = maxFace.width / 2;
+    size_t participants = ((_pool != nullptr) && (margin > 0)) ? _tileCascades.size() : 1;
+    int columns = 1;
+    int rows = 1;
+    int64_t smallest = (int64_t) frame.width * frame.height;
+    for (int c = 1; c <= (int) participants; c++)
+    {
+        int r = (int) participants / c;
+        int64_t width = min(frame.width, (frame.width + c - 1) / c + 2 * margin);
+        int64_t height = min(frame.height, (frame.height + r - 1) / r + 2 * margin);
+        if (width * height < smallest)
+        {
+            smallest = width * height;
+            columns = c;
+            rows = r;
+        }
+    }
+    if (columns * rows < 2)
+    {
+        _faceCascade->detectMultiScale( gray, _faces, 1.1, 3, 0, Size(), maxFace );
+        return;
+    }
+
+    size_t count = (size_t) (columns * rows);
+    _tiles.clear();
+    _cores.clear();
+    for (int r = 0; r < rows; r++)
+    {
+        for (int c = 0; c < columns; c++)
+        {
+            int left = c * frame.width / columns;
+            int top = r * frame.height / rows;
+            int right = (c + 1) * frame.width / columns;
+            int bottom = (r + 1) * frame.height / rows;
+            _cores.emplace_back(left, top, right - left, bottom - top);
+            left = max(0, left - margin);
+            top = max(0, top - margin);
+            right = min(frame.width, right + margin);
+            bottom = min(frame.height, bottom + margin);
+            _tiles.emplace_back(left, top, right - left, bottom - top);
+        }
+    }
+    _tileFaces.resize(count);
+    _pool->parallelFor(count, [this, &gray, maxFace](size_t i)
+    {
+        _tileCascades[i]->detectMultiScale( gray(_tiles[i]), _tileFaces[i], 1.1, 3, 0, Size(), maxFace );
+    });
+
+    _faces.clear();
+    for (size_t i = 0; i < count; i++)
+    {
+        const Rect & core = _cores[i];
+        for (Rect face : _tileFaces[i])
+        {
+            face.x += _tiles[i].x;
+            face.y += _tiles[i].y;
+            int x = face.x + face.width / 2;
+            int y = face.y + face.height / 2;
+            if ((x >= core.x) && (x < core.x + core.width) && (y >= core.y) && (y < core.y + core.height)) _faces.push_back(face);
+        }
+    }
+}
+
+// The gray image is passed on with the frame, since the eye detector searches in it. An
+// empty frame, from a file or a stream that could not be read, is passed on without faces.
+inline OperationStatus CVFaceDetector::operation(){
+    _faces.clear();
+    if (!_input->frame.empty())
+    {
+        if (_frames != nullptr) _output->gray = _frames->acquire(_input->frame.size(), CV_8UC1);
+        cvtColor( _input->frame, _output->gray, COLOR_BGR2GRAY );
+        equalizeHist( _output->gray, _output->gray );
+        //-- Detect faces
+        _detectFaces( _output->gray );
+    }
+    _facesFound += _faces.size();
+    swap(_output->frame, _input->frame);
+    _output->destinationFile = _input->destinationFile;
+    _output->readTime = _input->readTime;
+    _output->faces.assign(_faces.begin(), _faces.end());
+    return OperationStatus::running;
+};
+
+class CVEyeDetector : public Operator<ImageData, ImageData>
+{
+public:
+    CVEyeDetector(string opName, String eyesCascadeName): Operator(opName), _eyesCascadeName(eyesCascadeName)
+    {
+        _eyesCascades.emplace_back(CascadeProvider::instance().classifier(eyesCascadeName));
+        _loaded = (_eyesCascades.back() != nullptr);
+    };
+    OperationStatus operation() override;
+    bool loaded() { return _loaded; };
+
+    // Searches the faces of an image in parallel over the pool, with one classifier for each
+    // thread that takes part. False is returned if the classifiers cannot be loaded.
+    bool parallel(WorkStealingPool & pool)
+    {
+        _pool = &pool;
+        while (_eyesCascades.size() <= pool.workers())
+        {
+            _eyesCascades.emplace_back(CascadeProvider::instance().classifier(_eyesCascadeName));
+            if (_eyesCascades.back() == nullptr) return false;
+        }
+        return true;
+    };
+
+    // If given, the gray images are returned to the pool.
+    void pool(FramePool * frames) { _frames = frames; };
+
+private:
+    String _eyesCascadeName;
+    vector<unique_ptr<CascadeClassifier>> _eyesCascades;    // The first one is used without a pool
+    bool _loaded;
+    WorkStealingPool * _pool = nullptr;
+    vector<vector<Rect>> _eyes;                 // Eyes of each face, relative to the face
+    FramePool * _frames = nullptr;
+};
+
+inline OperationStatus CVEyeDetector::operation(){
+    const vector<Rect> & faces = _input->faces;
+    _eyes.resize(faces.size());
+    //-- In each face, detect eyes
+    if ((_pool == nullptr) || (faces.size() < 2))
+    {
+        for ( size_t i = 0; i < faces.size(); i++ ) _eyesCascades[0]->detectMultiScale( _input->gray( faces[i] ), _eyes[i] );
+    }
+    else
+    {
+        // Each thread that takes part has a classifier of its own, and takes the next face
+        // until all are done, so a large face does not hold up the others.
+        atomic<size_t> next {0};
+        size_t threads = min(faces.size(), _eyesCascades.size());
+        _pool->parallelFor(threads, [this, &faces, &next](size_t t)
+        {
+            for (size_t i = next++; i < faces.size(); i = next++)
+            {
+                _eyesCascades[t]->detectMultiScale( _input->gray( faces[i] ), _eyes[i] );
+            }
+        });
+    }
+    for ( size_t i = 0; i < faces.size(); i++ )
+    {
+        Point center( faces[i].x + faces[i].width/2, faces[i].y + faces[i].height/2 );
+        ellipse(_input->frame, center, Size( faces[i].width/2, faces[i].height/2 ), 0, 0, 360, Scalar( 255, 0, 255 ), 4 );
+        for ( size_t j = 0; j < _eyes[i].size(); j++ )
+        {
+            Point eye_center( faces[i].x + _eyes[i][j].x + _eyes[i][j].width/2, faces[i].y + _eyes[i][j].y + _eyes[i][j].height/2 );
+            int radius = cvRound( (_eyes[i][j].width + _eyes[i][j].height)*0.25 );
+            circle( _input->frame, eye_center, radius, Scalar( 255, 0, 0 ), 4 );
+        }
+    }
+    swap(_output->frame, _input->frame);
+    _output->destinationFile = _input->destinationFile;
+    _output->readTime = _input->readTime;
+    if (_frames != nullptr) _frames->release(_input->gray);
+    else swap(_output->gray, _input->gray);
+    _output->faces.assign(faces.begin(), faces.end());
+    return OperationStatus::running;
+};
@@ -0,0 +1,217 @@
+/*************************************************************************************
+ * Video source and sink for the face detection operators, for a continuous stream of
+ * frames instead of a directory of images:
+ *
+ *      1. CVVideoSourceOp reads a video file, a network stream or a camera with
+ *          cv::VideoCapture. A source made of digits only, e.g. "0", opens the camera with
+ *          that index, through V4L2 where it is available.
+ *      2. CVVideoWriterOp writes the frames to a video file with cv::VideoWriter. The file
+ *          is opened with the size of the first frame.
+ *
+ * The source reads each frame directly into the frame of the output of the SourceExecuter.
+ * The executer swaps that output into the buffer and gets back the frame of an item that
+ * has been consumed, and the next frame is read into it, so the frames are neither copied
+ * nor, once the buffers are full, allocated.
+ *
+ * The source always reads one frame ahead, so that it knows when it delivers the last
+ * frame and can end the stream right behind it, in the same way as the file reader.
+ *
+ * A camera does not wait for a slow pipeline. With latestFrameWins(), the frames are read
+ * in a thread of their own, and a frame that has not been taken by the pipeline when the
+ * next one arrives is dropped, see dropped(). The pipeline then always works on the latest
+ * frame and no backlog builds up in its buffers. For a video file, the frames can be read
+ * at the rate of the file, so that the file plays the part of a camera. In the same way,
+ * a ConflatingBuffer between two later stages keeps a slow stage on the newest frame.
+ *
+*************************************************************************************/
+#pragma once
+
+#include <string>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+
+#include <atomic>
+
+#include <operator.hpp>
+#include <metrics.hpp>
+#include <cvoperators.hpp>
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/videoio.hpp>
+
+using namespace std;
+using namespace cv;
+using namespace parallelOperators;
+
+
+class CVVideoSourceOp : public SourceOperator<ImageData>
+{
+public:
+    CVVideoSourceOp(string opName, string source) : SourceOperator(opName)
+    {
+        bool camera = !source.empty() && all_of(source.begin(), source.end(), [](char c) { return isdigit((unsigned char) c); });
+        if (camera)
+        {
+            if (!_capture.open(stoi(source), CAP_V4L2)) _capture.open(stoi(source));
+            _capture.set(CAP_PROP_BUFFERSIZE, 1);       // The driver should not queue old frames either
+        }
+        else
+        {
+            _capture.open(source);
+        }
+        _aheadTime = MetricsClock::now();
+        _last = !_capture.isOpened() || !_capture.read(_ahead);
+        _size = _ahead.size();
+    };
+    ~CVVideoSourceOp()
+    {
+        _stopping.store(true);
+        if (_grabber.joinable()) _grabber.join();
+    };
+    OperationStatus operation() override;
+
+    bool opened() { return _capture.isOpened(); };
+    double fps() { return _capture.get(CAP_PROP_FPS); };    // 0 if the stream does not tell
+    Size frameSize() { return _size; };                     // Size of the first frame
+
+    // Reads the frames in a thread of its own, at the given rate, or as fast as the stream
+    // delivers them if 0. A frame that is not taken before the next one is dropped.
+    // Called before the executer is started.
+    void latestFrameWins(double framesPerSecond = 0.0)
+    {
+        if (_grabber.joinable()) return;
+        _grabber = thread(&CVVideoSourceOp::_grab, this, framesPerSecond);
+    };
+
+    size_t delivered() { return _delivered.load(); };       // Frames sent into the pipeline
+    size_t dropped() { return _dropped.load(); };           // Frames dropped for a newer one
+
+    // If given, the first frames are read into frames from the pool.
+    void pool(FramePool * frames) { _frames = frames; };
+
+private:
+    VideoCapture _capture;
+    FramePool * _frames = nullptr;
+    Mat _ahead;                                 // The next frame, already read
+    MetricsClock::time_point _aheadTime;        // When the reading of the next frame started
+    bool _last;                                 // No frame could be read ahead, the stream has ended
+    Size _size;                                 // Size of the first frame
+    atomic<size_t> _delivered {0};
+    atomic<size_t> _dropped {0};
+
+    // Latest frame wins
+    thread _grabber;
+    atomic_bool _stopping {false};
+    mutex _mutex;                               // Protects the members below
+    condition_variable _condition;
+    Mat _latest;                                // The newest frame, waiting to be taken
+    MetricsClock::time_point _latestTime;
+    bool _fresh {false};                        // _latest has not been taken
+    bool _latestIsLast {false};
+    Mat _grabbed;                               // Frame being read, behind the one ahead
+
+    void _readAhead(Mat & into);
+    void _grab(double framesPerSecond);
+};
+
+// The frame is read into the Mat that was given back by the executer, or into one from the
+// pool while the executer has none to give back.
+inline void CVVideoSourceOp::_readAhead(Mat & into)
+{
+    if ((_frames != nullptr) && into.empty() && !_size.empty()) into = _frames->acquire(_size, CV_8UC3);
+    _aheadTime = MetricsClock::now();
+    _last = !_capture.read(into);
+}
+
+// A frame is published only when the one after it has been read, so that the last frame
+// is known to be the last.
+inline void CVVideoSourceOp::_grab(double framesPerSecond)
+{
+    nameThisThread(_opName + "_grabber");
+    chrono::nanoseconds period((framesPerSecond > 0.0) ? (int64_t) (1e9 / framesPerSecond) : 0);
+    MetricsClock::time_point next = MetricsClock::now();
+    bool last = false;
+    while (!last && !_stopping.load())
+    {
+        MetricsClock::time_point readTime = _aheadTime;
+        swap(_ahead, _grabbed);                 // The frame to publish, and a Mat for the next one
+        if (!_last) _readAhead(_ahead);
+        last = _last;
+        if (period.count() > 0)
+        {
+            next += period;
+            this_thread::sleep_until(next);
+        }
+        lock_guard<mutex> uLock(_mutex);
+        if (_fresh) _dropped++;
+        swap(_latest, _grabbed);
+        _latestTime = readTime;
+        _latestIsLast = last;
+        _fresh = true;
+        _condition.notify_all();
+    }
+}
+
+inline OperationStatus CVVideoSourceOp::operation()
+{
+    if (_grabber.joinable())
+    {
+        unique_lock<mutex> uLock(_mutex);
+        _condition.wait(uLock, [this] { return _fresh; });
+        swap(_output->frame, _latest);
+        _output->readTime = _latestTime;
+        _fresh = false;
+        if (!_output->frame.empty()) _delivered++;
+        return _latestIsLast ? OperationStatus::complete : OperationStatus::running;
+    }
+    swap(_output->frame, _ahead);
+    _output->readTime = _aheadTime;
+    if (!_last) _readAhead(_ahead);
+    if (!_output->frame.empty()) _delivered++;
+    return _last ? OperationStatus::complete : OperationStatus::running;
+}
+
+class CVVideoWriterOp : public SinkOperator<ImageData>
+{
+public:
+    // The fourcc code selects the codec, Motion JPEG in an AVI file by default, which
+    // OpenCV can write without any external library.
+    CVVideoWriterOp(string opName, string fileName, double fps, int fourcc = VideoWriter::fourcc('M', 'J', 'P', 'G')) :
+        SinkOperator(opName), _fileName(fileName), _fps((fps > 0.0) ? fps : 25.0), _fourcc(fourcc) {};
+    OperationStatus operation() override;
+
+    size_t written() { return _written; };
+    bool opened() { return _writer.isOpened(); };
+
+    // Completes the file, which is otherwise done when the writer is destroyed.
+    void close() { _writer.release(); };
+
+    // If given, the time from reading to the end of writing is recorded for each frame.
+    void latency(LatencyHistogram * histogram) { _latency = histogram; };
+
+    // If given, the written frames are returned to the pool.
+    void pool(FramePool * frames) { _frames = frames; };
+
+private:
+    string _fileName;
+    double _fps;
+    int _fourcc;
+    VideoWriter _writer;
+    size_t _written {0};
+    LatencyHistogram * _latency = nullptr;
+    FramePool * _frames = nullptr;
+};
+
+inline OperationStatus CVVideoWriterOp::operation()
+{
+    if (_input->frame.empty()) return OperationStatus::running;
+    if (!_writer.isOpened()) _writer.open(_fileName, _fourcc, _fps, _input->frame.size(), true);
+    _writer.write(_input->frame);
+    _written++;
+    if (_latency != nullptr) _latency->record(elapsedNanoseconds(_input->readTime, MetricsClock::now()));
+    if (_frames != nullptr) _frames->release(_input->frame);
+    return OperationStatus::running;
+}
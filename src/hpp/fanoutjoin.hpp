@@ -0,0 +1,367 @@
+/*************************************************************************************
+ * Fan-out and join executers allow a pipeline to branch, so that independent analyses of
+ * the same item, e.g. face detection and a histogram of the same frame, run in parallel
+ * instead of one after the other in one operator:
+ *
+ *                        +--> branch 0 --+
+ *      source --> FanOut +               + Join --> sink
+ *                        +--> branch 1 --+
+ *
+ * The FanOutExecuter receives each item from its input and sends it to all its outputs,
+ * in one of two ways, chosen by the output type:
+ *
+ *      1. FanOutExecuter<T>, broadcast: every branch gets an item of its own. The last
+ *          branch gets the received item by swapping, and the others get copies of it,
+ *          made by copyItem(). It copies with operator=, which for a type that shares its
+ *          memory when copied, e.g. one holding a cv::Mat, would let the branches share
+ *          it. Such a type overloads copyItem() in its own namespace with a deep copy.
+ *      2. FanOutExecuter<T, Shared<T>>, shared: the item is moved into a shared pointer
+ *          to a constant, which all branches read at the same time without any copy. When
+ *          the last branch has let go of it, the item is kept by the fan-out and handed
+ *          back to the input for a later item, as with the swaps of the other executers.
+ *          Only the control block of the shared pointer is allocated for every item.
+ *
+ * The JoinExecuter<T...> receives one item from each of its inputs and sends them on
+ * together in a tuple. The items are swapped into the tuple, so nothing is copied.
+ * Normally, each branch delivers one result for each item, in order, and the results are
+ * simply taken in turn. If all input types have a member sequence, e.g. the one given by
+ * Shared<T>, the join matches the sequence numbers instead: a branch that is behind has
+ * results that another branch has skipped, e.g. after a ConflatingBuffer, and they are
+ * dropped until all branches deliver the same sequence number, see dropped().
+ *
+ * Both run in their own threads, as the ReplicatedExecuter, and end the stream when their
+ * input ends, or for the join, when one of the inputs ends.
+ *
+*************************************************************************************/
+#pragma once
+
+#include <opsexecuter.hpp>
+
+#include <tuple>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <algorithm>
+#include <type_traits>
+#include <mutex>
+
+#include <atomic>
+
+#include <iostream>
+
+using namespace std;
+
+namespace parallelOperators
+{
+    // An item that is read by several branches, with its sequence number from the fan-out.
+    template <class T>
+    struct Shared
+    {
+        size_t sequence {0};
+        shared_ptr<const T> data;
+    };
+
+    // Copies an item for a branch of a broadcast, see above.
+    template <class T>
+    void copyItem(T & destination, const T & source)
+    {
+        destination = source;
+    }
+
+    template <class T, class = void>
+    struct hasSequence : false_type {};
+    template <class T>
+    struct hasSequence<T, void_t<decltype(declval<T &>().sequence)>> : true_type {};
+
+    template <class T_IN, class T_OUT = T_IN>
+    class FanOutExecuter : public BaseExecuter
+    {
+        static constexpr bool shared = is_same_v<T_OUT, Shared<T_IN>>;
+        static_assert(shared || is_same_v<T_OUT, T_IN>, "The outputs are either T_IN or Shared<T_IN>");
+
+    public:
+        FanOutExecuter(string tname, size_t branches): BaseExecuter(tname), _outputPorts(branches),
+                        _inputBuffer(make_unique<T_IN>())
+        {
+            for (size_t i = 0; i < branches; i++) _outputBuffers.emplace_back(make_unique<T_OUT>());
+        };
+        ~FanOutExecuter(){};
+
+        size_t branches() const
+        {
+            return _outputPorts.size();
+        };
+
+        // Input and outputs, with the same alternatives as in OperatorExecuter.
+        shared_ptr <BaseBuffer<T_IN>> input()
+        {
+            if (_inputPort == nullptr) _inputPort = make_shared<UniqueBuffer<T_IN>>(_tname + "_input_buffer");
+            return _inputPort;
+        };
+        void input(shared_ptr <BaseBuffer<T_IN>> inp)
+        {
+            if (inp != nullptr) _inputPort = inp;
+        };
+        shared_ptr <BaseBuffer<T_OUT>> output(size_t i)
+        {
+            if (_outputPorts[i] == nullptr) _outputPorts[i] = make_shared<UniqueBuffer<T_OUT>>(_tname + "_output_buffer_" + to_string(i));
+            return _outputPorts[i];
+        };
+        void output(size_t i, shared_ptr <BaseBuffer<T_OUT>> outp)
+        {
+            if (outp != nullptr) _outputPorts[i] = outp;
+        };
+
+        // The fan-out waits on its buffers only, so it always runs in its own thread.
+        void startTask(WorkStealingPool &) override
+        {
+            startThread();
+        }
+
+    private:
+        // Items that all branches have let go of, in shared mode. The branches may release
+        // an item after the fan-out has ended, so the list is owned by the items as well.
+        struct Recycled
+        {
+            mutex lock;
+            vector<unique_ptr<T_IN>> items;
+        };
+
+        shared_ptr<BaseBuffer<T_IN>> _inputPort = nullptr;
+        vector<shared_ptr<BaseBuffer<T_OUT>>> _outputPorts;
+        unique_ptr<T_IN> _inputBuffer;
+        vector<unique_ptr<T_OUT>> _outputBuffers;   // One per branch
+        size_t _nextSequence {0};
+        shared_ptr<Recycled> _recycled = make_shared<Recycled>();
+
+        void _terminateInputOutput()
+        {
+            input()->releaseAll();
+            for (size_t i = 0; i < branches(); i++) output(i)->releaseAll();
+        }
+
+        void _applyWaitPolicy()
+        {
+            input()->receivePolicy(_waitPolicy);
+            for (size_t i = 0; i < branches(); i++) output(i)->sendPolicy(_waitPolicy);
+        }
+
+        // The received item is handed to the branches, by sharing or by copying and swapping.
+        void _distribute()
+        {
+            if constexpr (shared)
+            {
+                shared_ptr<const T_IN> item(_inputBuffer.release(), [recycled = _recycled](const T_IN * released)
+                {
+                    lock_guard<mutex> uLock(recycled->lock);
+                    recycled->items.emplace_back(const_cast<T_IN *>(released));
+                });
+                {
+                    lock_guard<mutex> uLock(_recycled->lock);
+                    if (!_recycled->items.empty())
+                    {
+                        _inputBuffer = move(_recycled->items.back());
+                        _recycled->items.pop_back();
+                    }
+                }
+                if (_inputBuffer == nullptr) _inputBuffer = make_unique<T_IN>();
+                for (auto & out : _outputBuffers)
+                {
+                    out->sequence = _nextSequence;
+                    out->data = item;
+                }
+            }
+            else
+            {
+                for (size_t i = 0; i + 1 < _outputBuffers.size(); i++) copyItem(*_outputBuffers[i], *_inputBuffer);
+                if (!_outputBuffers.empty()) _outputBuffers.back().swap(_inputBuffer);
+            }
+            _nextSequence++;
+        }
+
+        void _execute(promise<void> && exitPromise) override
+        {
+            while (!_ending.load())
+            {
+                _waitForCommand();
+                if (_ending.load()) break;
+                if (!_timedReceive(*input(), _inputBuffer)) break;
+                MetricsClock::time_point start = MetricsClock::now();
+                _distribute();
+                _metrics.compute.record(elapsedNanoseconds(start, MetricsClock::now()));
+#ifdef DEBUG_PRINTOUT
+                cout << " 06) Sending item " << _nextSequence - 1 << " to all branches - " << _tname << "   \n";
+#endif
+                for (size_t i = 0; i < branches(); i++) _timedSend(*output(i), _outputBuffers[i]);
+                // The items that come back from the branches may still point to an earlier
+                // shared item, which could then not be recycled.
+                if constexpr (shared)
+                {
+                    for (auto & out : _outputBuffers) out->data.reset();
+                }
+            }
+            for (size_t i = 0; i < branches(); i++) output(i)->close();
+            _recordThreadTimes();
+            exitPromise.set_value();
+        }
+    };
+
+    template <class... T_IN>
+    class JoinExecuter : public BaseExecuter
+    {
+        static constexpr bool sequenced = (hasSequence<T_IN>::value && ...);
+
+    public:
+        using T_OUT = tuple<T_IN...>;
+        template <size_t I>
+        using T_INPUT = tuple_element_t<I, tuple<T_IN...>>;
+
+        JoinExecuter(string tname): BaseExecuter(tname), _inputBuffers(make_unique<T_IN>()...),
+                        _outputBuffer(make_unique<T_OUT>()) {};
+        ~JoinExecuter(){};
+
+        // Input I and the output, with the same alternatives as in OperatorExecuter.
+        template <size_t I>
+        shared_ptr <BaseBuffer<T_INPUT<I>>> input()
+        {
+            auto & port = get<I>(_inputPorts);
+            if (port == nullptr) port = make_shared<UniqueBuffer<T_INPUT<I>>>(_tname + "_input_buffer_" + to_string(I));
+            return port;
+        };
+        template <size_t I>
+        void input(shared_ptr <BaseBuffer<T_INPUT<I>>> inp)
+        {
+            if (inp != nullptr) get<I>(_inputPorts) = inp;
+        };
+        shared_ptr <BaseBuffer<T_OUT>> output()
+        {
+            if (_outputPort == nullptr) _outputPort = make_shared<UniqueBuffer<T_OUT>>(_tname + "_output_buffer");
+            return _outputPort;
+        };
+        void output(shared_ptr <BaseBuffer<T_OUT>> outp)
+        {
+            if (outp != nullptr) _outputPort = outp;
+        };
+
+        // Number of results that were dropped because another branch had skipped their item.
+        size_t dropped() const
+        {
+            return _dropped.load();
+        };
+
+        // The join waits on its buffers only, so it always runs in its own thread.
+        void startTask(WorkStealingPool &) override
+        {
+            startThread();
+        }
+
+    private:
+        static constexpr size_t inputs = sizeof...(T_IN);
+        using Indices = make_index_sequence<inputs>;
+
+        tuple<shared_ptr<BaseBuffer<T_IN>>...> _inputPorts;
+        shared_ptr<BaseBuffer<T_OUT>> _outputPort = nullptr;
+        tuple<unique_ptr<T_IN>...> _inputBuffers;
+        unique_ptr<T_OUT> _outputBuffer;
+        atomic<size_t> _dropped {0};
+
+        void _terminateInputOutput()
+        {
+            _terminateInputs(Indices{});
+            output()->releaseAll();
+        }
+        template <size_t... I>
+        void _terminateInputs(index_sequence<I...>)
+        {
+            (input<I>()->releaseAll(), ...);
+        }
+
+        void _applyWaitPolicy()
+        {
+            _applyInputPolicy(Indices{});
+            output()->sendPolicy(_waitPolicy);
+        }
+        template <size_t... I>
+        void _applyInputPolicy(index_sequence<I...>)
+        {
+            (input<I>()->receivePolicy(_waitPolicy), ...);
+        }
+
+        // One item from each input, in order. False if one of them has ended.
+        template <size_t... I>
+        bool _receiveAll(index_sequence<I...>)
+        {
+            return (_timedReceive(*input<I>(), get<I>(_inputBuffers)) && ...);
+        }
+
+        // Receives from input I until its sequence number has reached the target, and raises
+        // the target if it has passed it.
+        template <size_t I>
+        bool _catchUp(size_t & target)
+        {
+            auto & item = get<I>(_inputBuffers);
+            while ((size_t) item->sequence < target)
+            {
+                if (!_timedReceive(*input<I>(), item)) return false;
+                _dropped++;
+            }
+            target = max(target, (size_t) item->sequence);
+            return true;
+        }
+
+        // All inputs are brought to the highest sequence number among them.
+        template <size_t... I>
+        bool _align(index_sequence<I...>)
+        {
+            size_t target = max({(size_t) get<I>(_inputBuffers)->sequence...});
+            size_t previous;
+            do
+            {
+                previous = target;
+                if (!(_catchUp<I>(target) && ...)) return false;
+            } while (target != previous);
+            return true;
+        }
+
+        // When one input has ended, the results that are left in the others are dropped, so
+        // that their branches are not blocked and can end as well.
+        template <size_t I>
+        void _drain()
+        {
+            while (input<I>()->receive(get<I>(_inputBuffers))) _dropped++;
+        }
+        template <size_t... I>
+        void _drainAll(index_sequence<I...>)
+        {
+            (_drain<I>(), ...);
+        }
+
+        template <size_t... I>
+        void _combine(index_sequence<I...>)
+        {
+            (swap(get<I>(*_outputBuffer), *get<I>(_inputBuffers)), ...);
+        }
+
+        void _execute(promise<void> && exitPromise) override
+        {
+            while (!_ending.load())
+            {
+                _waitForCommand();
+                if (_ending.load()) break;
+                if (!_receiveAll(Indices{})) break;
+                if constexpr (sequenced)
+                {
+                    if (!_align(Indices{})) break;
+                }
+                MetricsClock::time_point start = MetricsClock::now();
+                _combine(Indices{});
+                _metrics.compute.record(elapsedNanoseconds(start, MetricsClock::now()));
+                _timedSend(*output(), _outputBuffer);
+            }
+            _drainAll(Indices{});
+            output()->close();
+            _recordThreadTimes();
+            exitPromise.set_value();
+        }
+    };
+}
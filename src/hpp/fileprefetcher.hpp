@@ -0,0 +1,169 @@
+/**************************************************************************************
+ * The file prefetcher reads a list of files in a thread of its own, ahead of the one
+ * that uses them. A source that reads a file only when it is allowed to produce waits for
+ * the disk every time the file is not in the page cache. With the prefetcher, the next
+ * files are read while the current one is processed, and the source takes the bytes from
+ * memory:
+ *
+ *      FilePrefetcher files(fileNames, 4, 64 << 20);
+ *      vector<uint8_t> bytes;
+ *      while (files.next(bytes)) { ... decode bytes ... }
+ *
+ * The read-ahead is bounded both by the number of files and by the bytes that are held.
+ * A file that alone is larger than the budget is still read, but only when nothing else
+ * is held. Before a file is read, the kernel is told with posix_fadvise() that the next
+ * file will be needed, so that the disk already works on it while the current one is
+ * copied.
+ *
+ * The files are delivered in the order of the list. A file that cannot be read is
+ * delivered with no bytes. The buffer passed to next() is swapped with the one that
+ * was read and is used again for a later file, so that the buffers are not allocated
+ * for every file once they have grown to the size of the files.
+ *
+ * **************************************************************************************/
+#pragma once
+
+#include <thread>
+#include <vector>
+#include <deque>
+#include <string>
+#include <algorithm>
+#include <filesystem>
+#include <system_error>
+#include <mutex>
+#include <condition_variable>
+
+#include <cstdint>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <metrics.hpp>
+
+using namespace std;
+
+namespace parallelOperators
+{
+    class FilePrefetcher
+    {
+    public:
+        FilePrefetcher(vector<filesystem::path> files, size_t depth, size_t budgetBytes):
+            _files(move(files)), _depth((depth > 0) ? depth : 1), _budget(budgetBytes)
+        {
+            _thread = thread(&FilePrefetcher::_run, this);
+        };
+        ~FilePrefetcher()
+        {
+            {
+                lock_guard<mutex> uLock(_mutex);
+                _ending = true;
+                _condition.notify_all();
+            }
+            if (_thread.joinable()) _thread.join();
+        };
+
+        // Waits for the next file and swaps its bytes into the buffer. False is returned
+        // after the last file.
+        bool next(vector<uint8_t> & bytes)
+        {
+            unique_lock<mutex> uLock(_mutex);
+            if (_delivered == _files.size()) return false;
+            _condition.wait(uLock, [this] { return !_ready.empty(); });
+            swap(bytes, _ready.front());
+            _heldBytes -= bytes.size();
+            _spare.emplace_back(move(_ready.front()));
+            _ready.pop_front();
+            _delivered++;
+            _condition.notify_all();
+            return true;
+        };
+
+        // The most bytes that were held at the same time, for checking the budget.
+        size_t peakBytes()
+        {
+            lock_guard<mutex> uLock(_mutex);
+            return _peakBytes;
+        };
+
+    private:
+        vector<filesystem::path> _files;
+        size_t _depth;                              // Files read ahead at most
+        size_t _budget;                             // Bytes held at most, unless one file is larger
+        thread _thread;
+        mutex _mutex;
+        condition_variable _condition;
+        deque<vector<uint8_t>> _ready;              // Files read and not yet delivered, in order
+        vector<vector<uint8_t>> _spare;             // Buffers given back by next()
+        size_t _heldBytes {0};
+        size_t _peakBytes {0};
+        size_t _delivered {0};
+        bool _ending {false};
+
+        static size_t _fileSize(const filesystem::path & file)
+        {
+            error_code error;
+            uintmax_t size = filesystem::file_size(file, error);
+            return error ? 0 : (size_t) size;
+        };
+
+        static void _advise(const filesystem::path & file)
+        {
+            int fd = ::open(file.c_str(), O_RDONLY);
+            if (fd < 0) return;
+            posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+            ::close(fd);
+        };
+
+        // The whole file is read with read() into the buffer, which only grows.
+        static void _read(const filesystem::path & file, vector<uint8_t> & bytes, size_t size)
+        {
+            bytes.resize(size);
+            int fd = ::open(file.c_str(), O_RDONLY);
+            if (fd < 0)
+            {
+                bytes.clear();
+                return;
+            }
+            posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+            size_t done = 0;
+            while (done < size)
+            {
+                ssize_t n = ::read(fd, bytes.data() + done, size - done);
+                if (n <= 0) break;
+                done += (size_t) n;
+            }
+            ::close(fd);
+            bytes.resize(done);
+        };
+
+        void _run()
+        {
+            nameThisThread("FilePrefetcher");
+            for (size_t i = 0; i < _files.size(); i++)
+            {
+                size_t size = _fileSize(_files[i]);
+                vector<uint8_t> bytes;
+                {
+                    unique_lock<mutex> uLock(_mutex);
+                    _condition.wait(uLock, [this, size] {
+                        return _ending || (_ready.empty() ||
+                               ((_ready.size() < _depth) && (_heldBytes + size <= _budget))); });
+                    if (_ending) return;
+                    if (!_spare.empty())
+                    {
+                        bytes = move(_spare.back());
+                        _spare.pop_back();
+                    }
+                }
+                if (i + 1 < _files.size()) _advise(_files[i + 1]);
+                _read(_files[i], bytes, size);
+                {
+                    lock_guard<mutex> uLock(_mutex);
+                    _heldBytes += bytes.size();
+                    _peakBytes = max(_peakBytes, _heldBytes);
+                    _ready.emplace_back(move(bytes));
+                    _condition.notify_all();
+                }
+            }
+        };
+    };
+}
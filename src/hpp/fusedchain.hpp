@@ -0,0 +1,92 @@
+/*************************************************************************************
+ * A fused chain links a number of operators at compile time and presents them as one
+ * operator, e.g.
+ *
+ *      FusedChain<Mult2, Div2Round, Add5, Div2> chain("fused", op1, op2, op3, op4);
+ *      exec.opInput(chain.inputAddress());
+ *      exec.opOutput(chain.outputAddress());
+ *      exec.addOperator(&chain);
+ *
+ * When the operators are added to an executer one by one, each of them is called through
+ * the virtual operation() and each link between two of them is a separate buffer on the
+ * heap. In the fused chain:
+ *
+ *      1. The types are checked at compile time, the output type of each operator must be
+ *          the input type of the next one.
+ *      2. The operations are called with their qualified names, so there is no virtual
+ *          dispatch inside the chain and the compiler sees one body that it can inline.
+ *      3. The intermediate results are kept inside the chain object, next to each other,
+ *          and the operators are wired to them once at construction.
+ *
+ * Only the chain itself is called virtually by the executer. The operators are owned by
+ * the caller, in the same way as when they are added directly to an executer.
+ *
+*************************************************************************************/
+#pragma once
+
+#include <string>
+#include <memory>
+#include <tuple>
+#include <type_traits>
+
+#include <operator.hpp>
+
+using namespace std;
+
+namespace parallelOperators
+{
+    // True if the output type of each operator is the input type of the next one.
+    template <class... Ops>
+    struct linkedOperators : true_type {};
+
+    template <class First, class Second, class... Rest>
+    struct linkedOperators<First, Second, Rest...> :
+        integral_constant<bool, is_same<typename First::output_type, typename Second::input_type>::value &&
+                                linkedOperators<Second, Rest...>::value> {};
+
+    template <class... Ops>
+    class FusedChain : public Operator<typename tuple_element<0, tuple<Ops...>>::type::input_type,
+                                       typename tuple_element<sizeof...(Ops) - 1, tuple<Ops...>>::type::output_type>
+    {
+        static_assert(sizeof...(Ops) > 0, "A fused chain needs at least one operator.");
+        static_assert(linkedOperators<Ops...>::value, "The output type of each operator must be the input type of the next one.");
+        static constexpr size_t last = sizeof...(Ops) - 1;
+    public:
+        FusedChain(string opName, Ops &... ops): Operator<typename tuple_element<0, tuple<Ops...>>::type::input_type,
+                                       typename tuple_element<last, tuple<Ops...>>::type::output_type>(opName), _ops(ops...)
+        {
+            _link(make_index_sequence<last>());
+        };
+
+        // The input of the first and the output of the last operator follow the chain, since
+        // the executer may point them to new locations before each call.
+        OperationStatus operation() override
+        {
+            get<0>(_ops).input(this->_input);
+            get<last>(_ops).output(this->_output);
+            OperationStatus status = OperationStatus::running;
+            apply([&status](Ops &... op)
+            {
+                ((status = _merge(status, op.Ops::operation())), ...);
+            }, _ops);
+            return status;
+        };
+
+    private:
+        tuple<Ops &...> _ops;                               // The operators, in order of execution
+        tuple<typename Ops::output_type...> _links;         // Intermediate results, the last one is not used
+
+        // Connects the output of operator I to the input of operator I + 1 through link I.
+        template <size_t... I>
+        void _link(index_sequence<I...>)
+        {
+            ((get<I>(_ops).output(&get<I>(_links)), get<I + 1>(_ops).input(&get<I>(_links))), ...);
+        };
+
+        // A chain is complete or in error as soon as one of its operators is.
+        static OperationStatus _merge(OperationStatus status, OperationStatus next)
+        {
+            return (status == OperationStatus::running) ? next : status;
+        };
+    };
+}
@@ -0,0 +1,253 @@
+/*************************************************************************************
+ * Metrics record where the time goes in a pipeline. Every Executer keeps latency
+ * histograms of:
+ *
+ *      1. the compute time of each of its operators,
+ *      2. the compute time of all operators together, per item,
+ *      3. the time its thread is blocked in receive, waiting for input data, and
+ *      4. the time its thread is blocked in send, waiting for space in the output.
+ *
+ * A stage with a high compute time and low waiting times is the bottleneck, and the
+ * stages around it will show long waits.
+ *
+ * The histograms are of the same kind as HDR histograms. The values, in nanoseconds, are
+ * counted in buckets with a fixed relative resolution. Each power of two is divided in
+ * 2^(subBucketBits - 1) buckets, so that every value is reported with an error of less
+ * than 2^-(subBucketBits - 1), i.e. about 3%, from one nanosecond up to about 18 minutes.
+ * Recording is a few relaxed atomic increments without any lock or allocation, so the
+ * percentiles can be read while the pipeline is running.
+ *
+ * When an Executer runs in its own thread, the CPU time and the wall time of the thread
+ * are also kept, which shows how busy each thread has been over its whole life.
+ *
+ * The threads of the framework, also those of a pool, a collector or a prefetcher, name
+ * themselves with nameThisThread(). The name is shown by top -H, and threadName() gives
+ * the full name for the kernel thread id, e.g. to report the CPU time of every thread of
+ * the process from /proc/self/task.
+ *
+*************************************************************************************/
+#pragma once
+
+#include <array>
+#include <vector>
+#include <string>
+#include <memory>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <cstdint>
+#include <ctime>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include <atomic>
+
+#include <iostream>
+#include <iomanip>
+
+using namespace std;
+
+namespace parallelOperators
+{
+    using MetricsClock = chrono::steady_clock;
+
+    inline uint64_t elapsedNanoseconds(MetricsClock::time_point start, MetricsClock::time_point end)
+    {
+        return (uint64_t) chrono::duration_cast<chrono::nanoseconds>(end - start).count();
+    }
+
+    // CPU time used by the calling thread since it started.
+    inline uint64_t threadCpuNanoseconds()
+    {
+        timespec ts;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+        return (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+    }
+
+    // The names given with nameThisThread(), by kernel thread id.
+    class ThreadNames
+    {
+    public:
+        static ThreadNames & instance()
+        {
+            static ThreadNames names;
+            return names;
+        };
+
+        void add(int tid, const string & name)
+        {
+            lock_guard<mutex> uLock(_mutex);
+            _names[tid] = name;
+        };
+
+        // An empty string if the thread was not named.
+        string name(int tid)
+        {
+            lock_guard<mutex> uLock(_mutex);
+            auto found = _names.find(tid);
+            return (found != _names.end()) ? found->second : string();
+        };
+
+    private:
+        mutex _mutex;
+        map<int, string> _names;
+    };
+
+    // Names the calling thread. The kernel keeps the first 15 characters.
+    inline void nameThisThread(const string & name)
+    {
+        pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+        ThreadNames::instance().add((int) syscall(SYS_gettid), name);
+    }
+
+    inline string threadName(int tid)
+    {
+        return ThreadNames::instance().name(tid);
+    }
+
+    // Summary of a histogram at one point in time, all values in nanoseconds.
+    struct LatencySnapshot
+    {
+        uint64_t count {0};
+        uint64_t mean {0};
+        uint64_t p50 {0};
+        uint64_t p99 {0};
+        uint64_t p999 {0};
+        uint64_t max {0};
+    };
+
+    class LatencyHistogram
+    {
+    public:
+        static constexpr int subBucketBits = 6;             // 32 buckets per power of two
+        static constexpr int maxValueBits = 40;             // Values up to 2^40 ns, larger ones are counted as the largest
+
+        LatencyHistogram()
+        {
+            reset();
+        };
+
+        void record(uint64_t nanoseconds)
+        {
+            _counts[_index(nanoseconds)].fetch_add(1, memory_order_relaxed);
+            _count.fetch_add(1, memory_order_relaxed);
+            _sum.fetch_add(nanoseconds, memory_order_relaxed);
+            uint64_t max = _max.load(memory_order_relaxed);
+            while ((nanoseconds > max) && !_max.compare_exchange_weak(max, nanoseconds, memory_order_relaxed));
+        };
+
+        // The smallest value that is larger than or equal to the given percentage of the
+        // recorded values, e.g. percentile(99.9). Reported as the highest value of its bucket.
+        uint64_t percentile(double percent) const
+        {
+            uint64_t total = _count.load(memory_order_relaxed);
+            if (total == 0) return 0;
+            uint64_t rank = (uint64_t) (percent / 100.0 * total + 0.5);
+            if (rank < 1) rank = 1;
+            uint64_t counted = 0;
+            for (size_t i = 0; i < buckets; i++)
+            {
+                counted += _counts[i].load(memory_order_relaxed);
+                if (counted >= rank) return min(_highestValue(i), _max.load(memory_order_relaxed));
+            }
+            return _max.load(memory_order_relaxed);
+        };
+
+        uint64_t count() const
+        {
+            return _count.load(memory_order_relaxed);
+        };
+
+        LatencySnapshot snapshot() const
+        {
+            LatencySnapshot s;
+            s.count = count();
+            s.mean = (s.count > 0) ? _sum.load(memory_order_relaxed) / s.count : 0;
+            s.p50 = percentile(50.0);
+            s.p99 = percentile(99.0);
+            s.p999 = percentile(99.9);
+            s.max = _max.load(memory_order_relaxed);
+            return s;
+        };
+
+        void reset()
+        {
+            for (atomic<uint64_t> & c : _counts) c.store(0, memory_order_relaxed);
+            _count.store(0, memory_order_relaxed);
+            _sum.store(0, memory_order_relaxed);
+            _max.store(0, memory_order_relaxed);
+        };
+
+    private:
+        static constexpr uint64_t subBuckets = uint64_t(1) << subBucketBits;
+        static constexpr uint64_t halfBuckets = subBuckets / 2;
+        static constexpr size_t buckets = (maxValueBits - subBucketBits + 2) * halfBuckets;
+
+        array<atomic<uint64_t>, buckets> _counts;   // Number of values per bucket
+        atomic<uint64_t> _count;                    // Number of values
+        atomic<uint64_t> _sum;                      // Sum of the values, for the mean
+        atomic<uint64_t> _max;                      // Largest value
+
+        // Values below subBuckets have one bucket each. Above that, a value with its highest
+        // bit at position b is shifted right by b - subBucketBits + 1, which leaves a number
+        // between halfBuckets and subBuckets, and that shift selects its row of buckets.
+        static size_t _index(uint64_t value)
+        {
+            if (value >= (uint64_t(1) << maxValueBits)) value = (uint64_t(1) << maxValueBits) - 1;
+            if (value < subBuckets) return (size_t) value;
+            int highestBit = 63 - __builtin_clzll(value);
+            int shift = highestBit - subBucketBits + 1;
+            return (size_t) (shift * halfBuckets + (value >> shift));
+        };
+        static uint64_t _highestValue(size_t index)
+        {
+            if (index < subBuckets) return index;
+            int shift = (int) (index / halfBuckets) - 1;
+            uint64_t mantissa = index - shift * halfBuckets;
+            return ((mantissa + 1) << shift) - 1;
+        };
+    };
+
+    // The histograms kept by each Executer.
+    struct ExecuterMetrics
+    {
+        LatencyHistogram compute;                   // All operators together, per item
+        LatencyHistogram receiveWait;               // Blocked in receive, waiting for input
+        LatencyHistogram sendWait;                  // Blocked in send, waiting for space
+        vector<string> operatorNames;               // In order of execution
+        vector<unique_ptr<LatencyHistogram>> operators;     // Compute time per operator, same order
+        atomic<uint64_t> threadCpu {0};             // CPU time of the thread, set when it ends
+        atomic<uint64_t> threadWall {0};            // Wall time of the thread, set when it ends
+
+        // One line per histogram, with count, mean, p50, p99, p999 and max in microseconds,
+        // and one line for the thread, with its CPU time as a share of its wall time.
+        void report(ostream & os, const string & name) const
+        {
+            _line(os, name + " compute", compute.snapshot());
+            _line(os, name + " receive wait", receiveWait.snapshot());
+            _line(os, name + " send wait", sendWait.snapshot());
+            for (size_t i = 0; i < operators.size(); i++) _line(os, name + " / " + operatorNames[i], operators[i]->snapshot());
+            uint64_t wall = threadWall.load(memory_order_relaxed);
+            if (wall == 0) return;
+            uint64_t cpu = threadCpu.load(memory_order_relaxed);
+            os << left << setw(48) << name + " thread" << right << fixed << setprecision(1)
+               << " cpu=" << setw(10) << cpu / 1e6 << " ms"
+               << " wall=" << setw(10) << wall / 1e6 << " ms"
+               << " busy=" << setw(6) << 100.0 * cpu / wall << " %\n";
+        };
+
+    private:
+        static void _line(ostream & os, const string & label, const LatencySnapshot & s)
+        {
+            if (s.count == 0) return;
+            os << left << setw(48) << label << right << fixed << setprecision(1)
+               << " n=" << setw(8) << s.count
+               << " mean=" << setw(10) << s.mean / 1e3
+               << " p50=" << setw(10) << s.p50 / 1e3
+               << " p99=" << setw(10) << s.p99 / 1e3
+               << " p999=" << setw(10) << s.p999 / 1e3
+               << " max=" << setw(10) << s.max / 1e3 << " us\n";
+        };
+    };
+}
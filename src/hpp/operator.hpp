@@ -62,6 +62,11 @@ namespace parallelOperators
         };
 
         virtual OperationStatus operation() = 0;  // Operation provided by the operator
+
+        const string & name() const
+        {
+            return _opName;
+        };
     protected:
         string _opName; // A string so that the object can be recognized.
     };
@@ -72,6 +77,9 @@ namespace parallelOperators
     class Operator : public BaseOperator
     {
     public:
+        using input_type = T_IN;            // Types of the data, so that operators can be linked
+        using output_type = T_OUT;          // at compile time, as in FusedChain.
+
         Operator(string opName) : BaseOperator(opName){};
 
         // Member function, deliveering the address to the input pointer so that the wrapper
@@ -158,6 +166,8 @@ namespace parallelOperators
     class SourceOperator : public BaseOperator
     {
     public:
+        using output_type = T_OUT;
+
         SourceOperator(string opName) : BaseOperator(opName){};
         T_OUT ** outputAddress()
         {
@@ -198,6 +208,8 @@ namespace parallelOperators
     class SinkOperator : public BaseOperator
     {
     public:
+        using input_type = T_IN;
+
         SinkOperator(string opName) : BaseOperator(opName){};
         T_IN ** inputAddress()
         {
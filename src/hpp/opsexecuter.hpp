@@ -33,13 +33,42 @@
  * 
  * The unique buffer is both offers means for exchange of data as well as a means for
  * synchronization between two threads in a sequence.
- * 
+ *
+ * The ports are typed with the common base class of the buffers, BaseBuffer. If nothing
+ * else is given, a unique buffer is created, but any other buffer, e.g. a RingBuffer with
+ * a few slots, can be connected with the same input() and output() calls.
+ *
+ * Instead of a thread of its own, an Executer can also run as a task in a work-stealing
+ * pool, started with startTask() instead of startThread(). The task executes steps as
+ * long as it can proceed without waiting. When the input is empty, the output is full
+ * or a step command is missing, it returns the worker thread to the pool and is submitted
+ * again by the buffer listeners or the next command.
+ *
+ * A stream of data ends at the source, either when its operators report that they are
+ * complete, or when finish() is called. The source closes its output buffer after the last
+ * item. Every Executer ends when it finds its input closed and empty, and closes its own
+ * output in turn, so the end of the stream travels behind the last item and no data in
+ * flight is lost. stop() is still available to end everything at once, without draining.
+ *
+ * Each Executer records the compute time of its operators and the time it is blocked in
+ * receive and send in latency histograms, see metrics.hpp. They are available through
+ * metrics() and report() at any time, also while the Executer is running. With
+ * PIPELINE_TRACE, the same points are also recorded on a timeline, see tracer.hpp.
+ *
+ * The thread of an Executer can be pinned to a set of CPUs, given a real-time priority and
+ * allocate its data on its own NUMA node, see placement() and threadplacement.hpp.
+ *
 *************************************************************************************/
+#pragma once
 
 #include <thread>
 #include <vector>
 #include <operator.hpp>
 #include <uniquebuffer.hpp>
+#include <threadpool.hpp>
+#include <metrics.hpp>
+#include <tracer.hpp>
+#include <threadplacement.hpp>
 
 #include <deque>
 #include <mutex>
@@ -63,6 +92,14 @@ namespace parallelOperators
         Continuous
     };
 
+    // Result of one step of an Executer that runs as a task in a pool.
+    enum StepResult
+    {
+        progressed = 0,
+        blocked,
+        finished
+    };
+
     // Base class containing the common part of the three types of executer.
     class BaseExecuter
     {
@@ -70,18 +107,21 @@ namespace parallelOperators
         BaseExecuter(string tname): _tname (tname), _executionMode(ExecutionMode::Step), 
                                 _newMessage(false), _futureExit(_exitPromise.get_future()),
                                 _opStatus(OperationStatus::running) {};
-        ~BaseExecuter()
+        virtual ~BaseExecuter()
         {
-            joinThreads();
+            join();
         };
 
-        // A static vector keeps all threads that are created and allow joining them at a suitable time.
-        static void joinThreads()
+        // Each Executer keeps its own thread and joins only that one, so that Executers of
+        // other pipelines are not waited for.
+        virtual void join()
         {
-            for (thread & t : _allThreads)
-            {
-                if (t.joinable()) t.join();
-            }
+            if (_thread.joinable()) _thread.join();
+        }
+
+        const string & name() const
+        {
+            return _tname;
         }
 
         // Commands to the Executer. It can switch between Step and Continuous.
@@ -93,11 +133,14 @@ namespace parallelOperators
 #ifdef DEBUG_PRINTOUT
             cout << " **) Execution mode command sent to - " << _tname << "   \n";
 #endif
-            lock_guard<mutex> uLock(_mutex);
-            _message = move(msg);
-            _executionMode = _message;
-            _newMessage = true;
-            _condition.notify_one();    // This is used when the execution is blocked by Step request.
+            {
+                lock_guard<mutex> uLock(_mutex);
+                _message = move(msg);
+                _executionMode = _message;
+                _newMessage = true;
+                _condition.notify_one();    // This is used when the execution is blocked by Step request.
+            }
+            if (_pool != nullptr) _wake();  // The same for a task in a pool.
         }
 
         // Stopping requestion by external unit. it sets the _ending variable so that the 
@@ -108,29 +151,106 @@ namespace parallelOperators
             cout << " **) stop() called  - " << _tname << "   \n";
 #endif
             _ending.store(true);
-            _condition.notify_all();    
+            {
+                lock_guard<mutex> uLock(_mutex);
+                _condition.notify_all();
+            }
             _terminateInputOutput();
+            if (_pool != nullptr) _wake();
+        }
+
+        // Request to end the stream. A source ends after the current item and closes its
+        // output, and the following Executers end when the last item has passed them.
+        void finish()
+        {
+#ifdef DEBUG_PRINTOUT
+            cout << " **) finish() called  - " << _tname << "   \n";
+#endif
+            _finishing.store(true);
+            {
+                lock_guard<mutex> uLock(_mutex);
+                _condition.notify_all();
+            }
+            if (_pool != nullptr) _wake();
+        }
+
+        // Selection of how the thread waits for step commands and for its input and output
+        // buffers. The policy is passed on to the buffers that are connected at the time of
+        // the call, so it should be called after the connections are made.
+        void waitPolicy(WaitPolicy policy)
+        {
+            _waitPolicy = policy;
+            _applyWaitPolicy();
         }
 
         // Adds a new operator in the vector. Operators will be executed in order.
         void addOperator(BaseOperator * op)
         {
             operators.emplace_back(op);
+            _metrics.operatorNames.emplace_back(op->name());
+            _metrics.operators.emplace_back(make_unique<LatencyHistogram>());
+#ifdef PIPELINE_TRACE
+            _traceNames.emplace_back(TRACE_INTERN(op->name()));
+#endif
         }
 
-        // After initialization, the thread is started and kept track of by the static 
-        // vector of the thread.
-        void startThread()
+        // Where and with which priority the thread runs. Given before the thread is started,
+        // and applied by the thread itself. False from placed() if it could not be applied.
+        void placement(const ThreadPlacement & placement)
+        {
+            _placement = placement;
+        }
+        bool placed() const
+        {
+            return _placed.load();
+        }
+
+        // Latency histograms of the operators and of the waiting in receive and send.
+        const ExecuterMetrics & metrics() const
+        {
+            return _metrics;
+        }
+        virtual void report(ostream & os) const
+        {
+            _metrics.report(os, _tname);
+        }
+
+        // After initialization, the thread is started and kept by the Executer until it is
+        // joined.
+        virtual void startThread()
         {
 #ifdef DEBUG_PRINTOUT
             cout << " **) Starting the thread  - " << _tname << "   \n";
 #endif
-            _allThreads.emplace_back(thread(&BaseExecuter::_execute, this, move(_exitPromise)));
+            // The buffers are created here if not yet connected, so that the thread and the
+            // caller, which may send to them right after this call, use the same ones.
+            _applyWaitPolicy();
+            _thread = thread([this](promise<void> && exitPromise)
+            {
+                TRACE_THREAD_NAME(_tname);
+                nameThisThread(_tname);
+                _applyPlacement();
+                _threadStart = MetricsClock::now();
+                _execute(move(exitPromise));
+            }, move(_exitPromise));
+        }
+
+        // Alternative to startThread(), where the Executer runs as a task in the pool. It is
+        // only scheduled when it can continue, i.e. after a command, new input data or free
+        // output space. The connections must be made before the call.
+        virtual void startTask(WorkStealingPool & pool)
+        {
+#ifdef DEBUG_PRINTOUT
+            cout << " **) Starting the task  - " << _tname << "   \n";
+#endif
+            _pool = &pool;
+            _connectListeners();
+            _wake();
         }
 
         // A promise is used to be able to follow the process and wait until the thread
         // has completed its task.
-        void waitToEnd()
+        virtual void waitToEnd()
         {
 #ifdef DEBUG_PRINTOUT
             cout << " **) Waiting for ending  - " << _tname << "   \n";
@@ -141,24 +261,179 @@ namespace parallelOperators
     protected:
         string _tname;                      // A name to allow following the process
         vector<BaseOperator *> operators;   // Collection of all operators to be executed serially
-        static vector<thread> _allThreads;  // Static collection for all threads
-        ExecutionMode _executionMode;       // Tracking the requested execution mode (Continuous or step-wise)
+        thread _thread;                     // The thread of the Executer, when not run as a task
+        atomic<ExecutionMode> _executionMode;   // Tracking the requested execution mode (Continuous or step-wise)
         ExecutionMode _message;             // Command to the Executer
         condition_variable _condition;      // Condition variable for waiting in step-mode
         mutex _mutex;                       // Mutex for protection of data and used for condition.wait()
         atomic_bool _ending = false;        // Boolean variable to stop the infinite loop.
-        bool _newMessage;                   // Indicator that new message has arrived.
+        atomic_bool _newMessage;            // Indicator that new message has arrived.
+        atomic_bool _finishing = false;     // The stream is requested to end, see finish()
+        WaitPolicy _waitPolicy = WaitPolicy::Block;     // How the thread waits for commands and data.
         OperationStatus _opStatus;          // Recording the status of operations. 
         promise<void> _exitPromise;         // Promise to follow up that the task is complete
         future<void> _futureExit;           // To be checked for exit.
+        ExecuterMetrics _metrics;           // Compute and waiting times
+        MetricsClock::time_point _threadStart;  // Start of the thread, for its wall time
+        ThreadPlacement _placement;         // CPUs, priority and memory of the thread
+        atomic_bool _placed = true;         // The placement was applied without errors
+#ifdef PIPELINE_TRACE
+        vector<const char *> _traceNames;   // Names of the operators in the trace
+#endif
+
+        // States of an Executer that runs as a task in a pool.
+        enum TaskState
+        {
+            idle = 0,                       // Waiting for a buffer or a command
+            scheduled,                      // Submitted to the pool
+            active,                         // Executing steps in a worker
+            rerun,                          // Executing steps, and woken up in the meantime
+            done                            // Finished, will not be scheduled again
+        };
+        static constexpr int stepsPerTask = 16;     // Steps before the worker is given to other tasks
+        WorkStealingPool * _pool = nullptr; // The pool when running as a task
+        atomic<int> _taskState {TaskState::idle};
+        bool _pendingOutput = false;        // A result waits for space in the output buffer
+
+        // Executes the operators one by one and records if one of them has completed the work.
+        // The time is read once between two operators, and gives the time of both.
+        void _runOperators()
+        {
+            MetricsClock::time_point start = MetricsClock::now();
+            MetricsClock::time_point previous = start;
+            for (size_t i = 0; i < operators.size(); i++)
+            {
+                TRACE_SCOPE(_traceNames[i], "operator");
+                if (operators[i]->operation() == OperationStatus::complete) 
+                {
+                    _opStatus = OperationStatus::complete;
+                }
+                MetricsClock::time_point now = MetricsClock::now();
+                _metrics.operators[i]->record(elapsedNanoseconds(previous, now));
+                previous = now;
+            }
+            _metrics.compute.record(elapsedNanoseconds(start, previous));
+        }
+
+        // Receive and send in the thread loops, with recording of the time they are blocked.
+        template <class T>
+        bool _timedReceive(BaseBuffer<T> & buffer, unique_ptr<T> & data)
+        {
+            TRACE_SCOPE(buffer.traceReceive(), "wait");
+            MetricsClock::time_point start = MetricsClock::now();
+            bool received = buffer.receive(data);
+            _metrics.receiveWait.record(elapsedNanoseconds(start, MetricsClock::now()));
+            return received;
+        }
+        template <class T>
+        void _timedSend(BaseBuffer<T> & buffer, unique_ptr<T> & data)
+        {
+            TRACE_SCOPE(buffer.traceSend(), "wait");
+            MetricsClock::time_point start = MetricsClock::now();
+            buffer.send(data);
+            _metrics.sendWait.record(elapsedNanoseconds(start, MetricsClock::now()));
+        }
+
+        // Called at the end of the thread, before the exit promise is fulfilled, so the
+        // times can be read as soon as waitToEnd() has returned.
+        void _recordThreadTimes()
+        {
+            _metrics.threadCpu.store(threadCpuNanoseconds(), memory_order_relaxed);
+            _metrics.threadWall.store(elapsedNanoseconds(_threadStart, MetricsClock::now()), memory_order_relaxed);
+        }
+
+        // Called at the start of the thread. The data of the stage is allocated after the
+        // affinity is set, so that it comes from the memory of the CPUs the thread runs on.
+        void _applyPlacement()
+        {
+            int error = placeThisThread(_placement);
+            if (error != 0)
+            {
+                _placed = false;
+                cout << " **) Thread placement could not be applied: " << strerror(error) << " - " << _tname << "   \n";
+            }
+            if (_placement.localMemory) _allocateLocal();
+        }
+
+        // Something has changed that may let the task continue. The task is submitted if
+        // it is idle, or asked to check again if it is being executed.
+        void _wake()
+        {
+            int state = _taskState.load();
+            while (true)
+            {
+                if (state == TaskState::idle)
+                {
+                    if (_taskState.compare_exchange_weak(state, TaskState::scheduled))
+                    {
+                        _pool->submit([this] { _runTask(); });
+                        return;
+                    }
+                }
+                else if (state == TaskState::active)
+                {
+                    if (_taskState.compare_exchange_weak(state, TaskState::rerun)) return;
+                }
+                else return;                // Already scheduled, or done.
+            }
+        }
+
+        // Executed in a worker of the pool. Steps are taken until the task cannot continue.
+        void _runTask()
+        {
+            _taskState = TaskState::active;
+            while (true)
+            {
+                StepResult result = StepResult::progressed;
+                for (int i = 0; (i < stepsPerTask) && (result == StepResult::progressed); i++) result = _step();
+                if (result == StepResult::finished)
+                {
+                    _taskState = TaskState::done;
+                    _exitPromise.set_value();
+                    return;
+                }
+                if (result == StepResult::progressed)
+                {
+                    // Give the other tasks a chance before continuing.
+                    _taskState = TaskState::scheduled;
+                    _pool->submit([this] { _runTask(); });
+                    return;
+                }
+                int state = TaskState::active;
+                if (_taskState.compare_exchange_strong(state, TaskState::idle)) return;
+                _taskState = TaskState::active;     // Woken up while checking, check again.
+            }
+        }
+
+        // In step mode, the thread waits for a new command. Depending on the wait policy, the
+        // command is first expected by spinning and only after that on the condition variable.
+        void _waitForCommand()
+        {
+            if ((_executionMode == ExecutionMode::Step) && (!_ending.load()) && (!_finishing.load()))
+            {
+#ifdef DEBUG_PRINTOUT
+                cout << " 02) Waiting for command  - " << _tname << "   \n";
+#endif
+                // Messages change the mode, or signal to step forward. The change of
+                // mode is already affected in the 'send' method. Here, we check
+                // that the _condition is notified AND that actually a message has arrived.
+                // If there is an ending request, we do not wait for a new message.
+                spinWait(_waitPolicy, [this] { return (_newMessage.load() || _ending.load() || _finishing.load()); });
+                unique_lock<mutex> uLock(_mutex);
+                _condition.wait(uLock, [this] { return (_newMessage.load() || _ending.load() || _finishing.load()); });
+                _newMessage = false;
+            }
+        }
 
         virtual void _execute(promise<void> && exitPromise) = 0;        // The task manager that will be executed in the thread
         virtual void _terminateInputOutput() = 0;                       // A routine for termination of inputs and outputs to be 
                                                                         // implemented by child classes
+        virtual void _applyWaitPolicy() = 0;                            // Passing the wait policy on to the buffers
+        virtual StepResult _step() { return StepResult::finished; };   // One step without waiting, when run as a task
+        virtual void _connectListeners() {};                            // Letting the buffers wake up the task
+        virtual void _allocateLocal() {};                               // Allocating the data of the stage in its thread
     };
 
-    vector<thread> BaseExecuter::_allThreads{};       // The static vector variable collecting all threads.
-
     //---------------------------------------------------------------------------------
     // The complete implementation of an executer with both input and output. 
     // It receives an input data and passes it through its operators one by one and finally
@@ -174,7 +449,7 @@ namespace parallelOperators
         // A shared pointer to a unique buffer will be created and shared with the other executer that
         // is expected to provide the input. The transfer of data will be through swapping of resources
         // between the local unique pointer and the unique buffer.
-        shared_ptr <UniqueBuffer<T_IN>> input()
+        shared_ptr <BaseBuffer<T_IN>> input()
         {
             if (_inputPort == nullptr) _inputPort = make_shared<UniqueBuffer<T_IN>>(_tname + "_input_buffer");
             return _inputPort;
@@ -182,7 +457,7 @@ namespace parallelOperators
 
         // This is the alternative connection where the lifecycle of the unique buffer will be managed
         // by the other Executer, but the access is garanted to this one.
-        void input(shared_ptr <UniqueBuffer<T_IN>> inp)
+        void input(shared_ptr <BaseBuffer<T_IN>> inp)
         {
             if (inp != nullptr)
             {
@@ -192,14 +467,14 @@ namespace parallelOperators
         };
 
         // Similar to above resource is allocated and is offered to the input of the neighboring executer.
-        shared_ptr <UniqueBuffer<T_OUT>> output()
+        shared_ptr <BaseBuffer<T_OUT>> output()
         {
             if (_outputPort == nullptr) _outputPort = make_shared<UniqueBuffer<T_OUT>>(_tname + "_output_buffer");
             return _outputPort;
         };
 
         // Similar to above resource is allocated by the neighboring executer and will be offered here.
-        void output(shared_ptr <UniqueBuffer<T_OUT>> outp)
+        void output(shared_ptr <BaseBuffer<T_OUT>> outp)
         {
             if (outp != nullptr)
             {
@@ -221,13 +496,31 @@ namespace parallelOperators
         };
 
     private:
-        T_IN ** _opInput;           // pointer to the input pointer of first operator
-        T_OUT ** _opOutput;         // pointer to the output pointer of last operator
-        shared_ptr<UniqueBuffer<T_IN>> _inputPort = nullptr;        // One buffer is needed between two Executers but
-        shared_ptr<UniqueBuffer<T_OUT>> _outputPort = nullptr;      // it does not matter which one manages the lifetime
+        T_IN ** _opInput = nullptr;     // pointer to the input pointer of first operator
+        T_OUT ** _opOutput = nullptr;   // pointer to the output pointer of last operator
+        shared_ptr<BaseBuffer<T_IN>> _inputPort = nullptr;        // One buffer is needed between two Executers but
+        shared_ptr<BaseBuffer<T_OUT>> _outputPort = nullptr;      // it does not matter which one manages the lifetime
         unique_ptr<T_IN> _inputBuffer;              // Internal input buffer to store data locally in the thread 
         unique_ptr<T_OUT> _outputBuffer;            // Internal output buffer to store data locally in the thread 
 
+        // The buffers exchange data by swapping, so after every receive and send, the local
+        // buffers hold other objects than before. The input of the first operator and the output
+        // of the last operator are pointed to them before each execution, so that the data is
+        // used where it is, without copying.
+        void _bindOperators()
+        {
+            if (_opInput != nullptr) *_opInput = _inputBuffer.get();
+            if (_opOutput != nullptr) *_opOutput = _outputBuffer.get();
+        }
+
+        // The local buffers and the free slots of the output are allocated again by the thread.
+        void _allocateLocal() override
+        {
+            _inputBuffer = make_unique<T_IN>();
+            _outputBuffer = make_unique<T_OUT>();
+            output()->allocateSlots();
+        }
+
         // implementation of the termination functino for the buffers. 
         void _terminateInputOutput()
         {
@@ -235,30 +528,64 @@ namespace parallelOperators
             output()->releaseAll();
         }
 
+        // This thread receives from the input buffer and sends to the output buffer.
+        void _applyWaitPolicy()
+        {
+            input()->receivePolicy(_waitPolicy);
+            output()->sendPolicy(_waitPolicy);
+        }
+
+        // When run as a task, new input data and free space in the output buffer wake it up.
+        void _connectListeners() override
+        {
+            input()->onData([this] { _wake(); });
+            output()->onSpace([this] { _wake(); });
+        }
+
+        // One step of the same loop as in _execute below, but without waiting. A result that
+        // cannot be sent is kept until the next step.
+        StepResult _step() override
+        {
+            if (_pendingOutput)
+            {
+                if (output()->trySend(_outputBuffer))
+                {
+                    _pendingOutput = false;
+                    if (_opStatus == OperationStatus::complete) _ending.store(true);
+                    return StepResult::progressed;
+                }
+                if (!_ending.load()) return StepResult::blocked;
+            }
+            if (_ending.load())
+            {
+                output()->close();
+                return StepResult::finished;
+            }
+            if ((_executionMode == ExecutionMode::Step) && !_newMessage.load()) return StepResult::blocked;
+            if (!input()->tryReceive(_inputBuffer))
+            {
+                if (!input()->endOfStream()) return StepResult::blocked;
+                _ending.store(true);
+                output()->close();
+                return StepResult::finished;
+            }
+            _newMessage = false;
+            _bindOperators();
+            _runOperators();
+            _pendingOutput = true;
+            return StepResult::progressed;
+        }
+
         // This is the main task executer, which organizes and executes all tasks defined 
         // by operators.
         void _execute(promise<void> && exitPromise) override
         {
-            OperationStatus opStat;             // Saves the intermediate status of the execution. 
             while (!_ending.load())             // Loop as long as no ending request appears.
             {
-                unique_lock<mutex> uLock(_mutex);
 #ifdef DEBUG_PRINTOUT
                 cout << " 01) Loop starts  - " << _tname << "   \n";
 #endif
-                if ((_executionMode == ExecutionMode::Step) && (!_ending.load()))
-                {
-#ifdef DEBUG_PRINTOUT
-                    cout << " 02) Waiting for command  - " << _tname << "   \n";
-#endif
-                    // Messages change the mode, or signal to step forward. The change of
-                    // mode is already affected in the 'send' method. Here, we check
-                    // that the _condition is notified AND that actually a message has arrived.
-                    // If there is an ending request, we do not wait for a new message.
-                    _condition.wait(uLock, [this] { return (_newMessage || _ending.load()); }); 
-                    _newMessage = false;
-                }
-                uLock.unlock();
+                _waitForCommand();
 #ifdef DEBUG_PRINTOUT
                 cout << " 03) Loop resumed  - " << _tname << "   \n";
 #endif
@@ -268,17 +595,13 @@ namespace parallelOperators
 #ifdef DEBUG_PRINTOUT
                    cout << " 04) Reading the input  - " << _tname << "   \n";
 #endif
-                    input()->receive(_inputBuffer);         // Wait until there is input data
-                    *_opInput = _inputBuffer.get();         // Get the address of the input data and set to the input of the first operator
-                    *_opOutput = _outputBuffer.get();       // Get the address of the input data and set to the output of the last operator
-                    for ( auto op : operators)
+                    if (!_timedReceive(*input(), _inputBuffer))     // Wait until there is input data, or the stream has ended
                     {
-                        opStat = op->operation();           // Perform the operation and take necessary actions if the process is finished
-                        if (opStat == OperationStatus::complete) 
-                        {
-                            _opStatus = OperationStatus::complete;
-                        }
+                        _ending.store(true);
+                        break;
                     }
+                    _bindOperators();                       // Point the first and last operators to the swapped-in data
+                    _runOperators();                        // Perform the operations and take necessary actions if the process is finished
                     if (_opStatus == OperationStatus::complete)
                     {
                         _ending.store(true);                // Set the ending signal to terminate
@@ -289,12 +612,14 @@ namespace parallelOperators
 #ifdef DEBUG_PRINTOUT
                     cout << " 06) Setting the output  - " << _tname << "   \n";
 #endif
-                    output()->send(_outputBuffer);          // Set the output buffer and wait until it is consumed. Note that othereise
+                    _timedSend(*output(), _outputBuffer);   // Set the output buffer and wait until it is consumed. Note that othereise
                 }                                           // setting the pointer to the address becomes partial.
             }
 #ifdef DEBUG_PRINTOUT
             cout << " 07) Loop completed  - " << _tname << "   \n";
 #endif
+            output()->close();                              // The end of the stream follows the last output
+            _recordThreadTimes();
             exitPromise.set_value();                        // Signal that the promise is fulfilled
         }
    };
@@ -309,12 +634,12 @@ namespace parallelOperators
         SourceExecuter(string tname): BaseExecuter(tname), _outputBuffer(make_unique<T_OUT>()) {};
         ~SourceExecuter(){};
 
-        shared_ptr <UniqueBuffer<T_OUT>> output()
+        shared_ptr <BaseBuffer<T_OUT>> output()
         {
             if (_outputPort == nullptr) _outputPort = make_shared<UniqueBuffer<T_OUT>>(_tname + "_output_buffer");
             return _outputPort;
         };
-        void output(shared_ptr <UniqueBuffer<T_OUT>> outp)
+        void output(shared_ptr <BaseBuffer<T_OUT>> outp)
         {
             if (outp != nullptr)
             {
@@ -328,42 +653,26 @@ namespace parallelOperators
         };
 
     private:
-        T_OUT ** _opOutput;
-        shared_ptr<UniqueBuffer<T_OUT>> _outputPort = nullptr;
+        T_OUT ** _opOutput = nullptr;
+        shared_ptr<BaseBuffer<T_OUT>> _outputPort = nullptr;
         unique_ptr<T_OUT> _outputBuffer;
 
         void _execute(promise<void> && exitPromise) override
         {
-            OperationStatus opStat;
             while (!_ending.load())
             {
-                unique_lock<mutex> uLock(_mutex);
 #ifdef DEBUG_PRINTOUT
                 cout << " 01) Loop starts  - " << _tname << "   \n";
 #endif
-                if ((_executionMode == ExecutionMode::Step) && (!_ending.load()))
-                {
-#ifdef DEBUG_PRINTOUT
-                    cout << " 02) Waiting for command  - " << _tname << "   \n";
-#endif
-                    _condition.wait(uLock, [this] { return (_newMessage || _ending.load()); }); 
-                    _newMessage = false;
-                }
-                uLock.unlock();
+                _waitForCommand();
 #ifdef DEBUG_PRINTOUT
                 cout << " 03) Loop resumed  - " << _tname << "   \n";
 #endif
+                if (_finishing.load()) break;
                 if (!_ending.load())
                 {
-                    *_opOutput = _outputBuffer.get();
-                    for ( auto op : operators)
-                    {
-                        opStat = op->operation();
-                        if (opStat == OperationStatus::complete) 
-                        {
-                            _opStatus = OperationStatus::complete;
-                        }
-                    }
+                    _bindOperators();
+                    _runOperators();
                     if (_opStatus == OperationStatus::complete)
                     {
                         _ending.store(true);
@@ -374,19 +683,62 @@ namespace parallelOperators
 #ifdef DEBUG_PRINTOUT
                     cout << " 06) Setting the output  - " << _tname << "   \n";
 #endif
-                    output()->send(_outputBuffer);
+                    _timedSend(*output(), _outputBuffer);
                 }
             }
 #ifdef DEBUG_PRINTOUT
             cout << " 07) Loop completed  - " << _tname << "   \n";
 #endif
+            output()->close();
+            _recordThreadTimes();
             exitPromise.set_value();
         }
 
+        void _bindOperators()
+        {
+            if (_opOutput != nullptr) *_opOutput = _outputBuffer.get();
+        }
         void _terminateInputOutput()
         {
             output()->releaseAll();
         }
+        void _allocateLocal() override
+        {
+            _outputBuffer = make_unique<T_OUT>();
+            output()->allocateSlots();
+        }
+        void _applyWaitPolicy()
+        {
+            output()->sendPolicy(_waitPolicy);
+        }
+        void _connectListeners() override
+        {
+            output()->onSpace([this] { _wake(); });
+        }
+        StepResult _step() override
+        {
+            if (_pendingOutput)
+            {
+                if (output()->trySend(_outputBuffer))
+                {
+                    _pendingOutput = false;
+                    if (_opStatus == OperationStatus::complete) _ending.store(true);
+                    return StepResult::progressed;
+                }
+                if (!_ending.load()) return StepResult::blocked;
+            }
+            if (_ending.load() || _finishing.load())
+            {
+                output()->close();
+                return StepResult::finished;
+            }
+            if ((_executionMode == ExecutionMode::Step) && !_newMessage.load()) return StepResult::blocked;
+            _newMessage = false;
+            _bindOperators();
+            _runOperators();
+            _pendingOutput = true;
+            return StepResult::progressed;
+        }
     };
 
     //---------------------------------------------------------------------------------
@@ -400,12 +752,12 @@ namespace parallelOperators
         SinkExecuter(string tname): BaseExecuter(tname), _inputBuffer(make_unique<T_IN>()) {};
         ~SinkExecuter(){};
 
-        shared_ptr <UniqueBuffer<T_IN>> input()
+        shared_ptr <BaseBuffer<T_IN>> input()
         {
             if (_inputPort == nullptr) _inputPort = make_shared<UniqueBuffer<T_IN>>(_tname + "_input_buffer");
             return _inputPort;
         };
-        void input(shared_ptr <UniqueBuffer<T_IN>> inp)
+        void input(shared_ptr <BaseBuffer<T_IN>> inp)
         {
             if (inp != nullptr)
             {
@@ -417,33 +769,19 @@ namespace parallelOperators
         {
             _opInput = inp;
         };
-        void addOperator(BaseOperator * op)
-        {
-            operators.emplace_back(op);
-        };
     private:
-        T_IN ** _opInput;
-        shared_ptr<UniqueBuffer<T_IN>> _inputPort = nullptr;
+        T_IN ** _opInput = nullptr;
+        shared_ptr<BaseBuffer<T_IN>> _inputPort = nullptr;
         unique_ptr<T_IN> _inputBuffer;
 
         void _execute(promise<void> && exitPromise) override
         {
-            OperationStatus opStat;
             while (!_ending.load())
             {
-                unique_lock<mutex> uLock(_mutex);
 #ifdef DEBUG_PRINTOUT
                 cout << " 01) Loop starts  - " << _tname << "   \n";
 #endif
-                if ((_executionMode == ExecutionMode::Step) && (!_ending.load()))
-                {
-#ifdef DEBUG_PRINTOUT
-                    cout << " 02) Waiting for command  - " << _tname << "   \n";
-#endif
-                    _condition.wait(uLock, [this] { return (_newMessage || _ending.load()); }); 
-                    _newMessage = false;
-                }
-                uLock.unlock();
+                _waitForCommand();
 #ifdef DEBUG_PRINTOUT
                 cout << " 03) Loop resumed  - " << _tname << "   \n";
 #endif
@@ -452,16 +790,13 @@ namespace parallelOperators
 #ifdef DEBUG_PRINTOUT
                    cout << " 04) Reading the input  - " << _tname << "   \n";
 #endif
-                     input()->receive(_inputBuffer);
-                    *_opInput = _inputBuffer.get();
-                    for ( auto op : operators)
+                    if (!_timedReceive(*input(), _inputBuffer))
                     {
-                        opStat = op->operation();
-                        if (opStat == OperationStatus::complete) 
-                        {
-                            _opStatus = OperationStatus::complete;
-                        }
+                        _ending.store(true);
+                        break;
                     }
+                    _bindOperators();
+                    _runOperators();
                     if (_opStatus == OperationStatus::complete)
                     {
                         _ending.store(true);
@@ -474,12 +809,44 @@ namespace parallelOperators
 #ifdef DEBUG_PRINTOUT
             cout << " 07) Loop completed  - " << _tname << "   \n";
 #endif
+            _recordThreadTimes();
             exitPromise.set_value();
         }
+        void _bindOperators()
+        {
+            if (_opInput != nullptr) *_opInput = _inputBuffer.get();
+        }
         void _terminateInputOutput()
         {
             input()->releaseAll();
         }
+        void _allocateLocal() override
+        {
+            _inputBuffer = make_unique<T_IN>();
+        }
+        void _applyWaitPolicy()
+        {
+            input()->receivePolicy(_waitPolicy);
+        }
+        void _connectListeners() override
+        {
+            input()->onData([this] { _wake(); });
+        }
+        StepResult _step() override
+        {
+            if (_ending.load()) return StepResult::finished;
+            if ((_executionMode == ExecutionMode::Step) && !_newMessage.load()) return StepResult::blocked;
+            if (!input()->tryReceive(_inputBuffer)) return (input()->endOfStream() ? StepResult::finished : StepResult::blocked);
+            _newMessage = false;
+            _bindOperators();
+            _runOperators();
+            if (_opStatus == OperationStatus::complete)
+            {
+                _ending.store(true);
+                return StepResult::finished;
+            }
+            return StepResult::progressed;
+        }
     };
 
 }
@@ -0,0 +1,212 @@
+/*************************************************************************************
+ * The partitioner decides which operators of a chain share a thread, from their measured
+ * costs instead of by hand. The throughput of a pipeline is set by its slowest stage, so
+ * for a given number of threads, the chain is divided into that many stages of consecutive
+ * operators such that the time of the slowest stage is as small as possible:
+ *
+ *      ChainPartitioner<ImageData> chain("Analysis", {&blur, &detect, &track, &draw}, 2);
+ *      chain.profile(samples);                         // A few items through each operator
+ *      chain.build(pipeline.source(reader)).sink(writer);
+ *
+ * profile() runs sample items through the operators in the calling thread, one operator
+ * after the other, and records the time of each. The first items are not counted, so
+ * that the caches and the buffers of the operators are warm. The cost of an operator is
+ * its median time, so that an item that was interrupted by another thread does not move
+ * the partition.
+ *
+ * The costs change when the data changes, e.g. when more faces appear in the images.
+ * While the pipeline runs, the Executers keep measuring each operator, and update() reads
+ * these times from Pipeline::stats(). If another partition would make the slowest stage
+ * faster by more than a tolerance, it becomes the new partition, and the chain can be
+ * built again in a new pipeline after the current one has been finished.
+ *
+ * Since the stages are chosen at run time, all operators of the chain have the same input
+ * and output type. The operators are found in the statistics by their names, which must be
+ * unique within the chain. For a chain of different types, balance() gives the partition
+ * from a list of costs, and the Executers are set up by hand.
+ *
+*************************************************************************************/
+#pragma once
+
+#include <string>
+#include <vector>
+#include <limits>
+#include <algorithm>
+
+#include <operator.hpp>
+#include <metrics.hpp>
+#include <pipeline.hpp>
+
+using namespace std;
+
+namespace parallelOperators
+{
+    // A division of a chain into stages of consecutive operators.
+    struct Partition
+    {
+        vector<size_t> firsts;              // Index of the first operator of each stage
+        uint64_t bottleneck {0};            // Time of the slowest stage, per item
+
+        size_t stages() const
+        {
+            return firsts.size();
+        };
+    };
+
+    // Time of the slowest stage when the operators with the given costs are divided as given.
+    inline uint64_t bottleneck(const vector<uint64_t> & costs, const vector<size_t> & firsts)
+    {
+        uint64_t slowest = 0;
+        for (size_t s = 0; s < firsts.size(); s++)
+        {
+            size_t end = (s + 1 < firsts.size()) ? firsts[s + 1] : costs.size();
+            uint64_t time = 0;
+            for (size_t i = firsts[s]; i < end; i++) time += costs[i];
+            slowest = max(slowest, time);
+        }
+        return slowest;
+    }
+
+    // The division of the operators into the given number of stages, or one per operator if
+    // there are fewer operators, with the smallest time of the slowest stage. Dynamic
+    // programming over the prefixes of the chain: slowest[s][i] is the best bottleneck of
+    // the first i operators in s stages.
+    inline Partition balance(const vector<uint64_t> & costs, size_t stages)
+    {
+        size_t n = costs.size();
+        Partition partition;
+        if (n == 0) return partition;
+        stages = min(max(stages, (size_t) 1), n);
+
+        vector<uint64_t> prefix(n + 1, 0);
+        for (size_t i = 0; i < n; i++) prefix[i + 1] = prefix[i] + costs[i];
+
+        const uint64_t none = numeric_limits<uint64_t>::max();
+        vector<vector<uint64_t>> slowest(stages + 1, vector<uint64_t>(n + 1, none));
+        vector<vector<size_t>> first(stages + 1, vector<size_t>(n + 1, 0));
+        slowest[0][0] = 0;
+        for (size_t s = 1; s <= stages; s++)
+        {
+            for (size_t i = s; i <= n; i++)
+            {
+                for (size_t j = s - 1; j < i; j++)
+                {
+                    if (slowest[s - 1][j] == none) continue;
+                    uint64_t time = max(slowest[s - 1][j], prefix[i] - prefix[j]);
+                    if (time < slowest[s][i])
+                    {
+                        slowest[s][i] = time;
+                        first[s][i] = j;
+                    }
+                }
+            }
+        }
+
+        partition.bottleneck = slowest[stages][n];
+        partition.firsts.resize(stages);
+        for (size_t s = stages, i = n; s > 0; s--)
+        {
+            i = first[s][i];
+            partition.firsts[s - 1] = i;
+        }
+        return partition;
+    }
+
+    template <class T>
+    class ChainPartitioner
+    {
+    public:
+        ChainPartitioner(string cname, vector<Operator<T, T> *> ops, size_t threads):
+            _cname(cname), _ops(move(ops)), _threads(threads), _costs(_ops.size(), 0)
+        {
+            _partition = balance(_costs, _threads);
+        };
+
+        // Runs the samples through the operators, in order, and partitions the chain by the
+        // median time of each operator. The first warmUp samples are not counted, unless there
+        // are no others.
+        void profile(const vector<T> & samples, size_t warmUp = 1)
+        {
+            if (samples.empty() || _ops.empty()) return;
+            if (warmUp >= samples.size()) warmUp = 0;
+            vector<LatencyHistogram> histograms(_ops.size());
+            vector<T> links(_ops.size() + 1);
+            for (size_t i = 0; i < _ops.size(); i++)
+            {
+                _ops[i]->input(&links[i]);
+                _ops[i]->output(&links[i + 1]);
+            }
+            for (size_t k = 0; k < samples.size(); k++)
+            {
+                links[0] = samples[k];
+                for (size_t i = 0; i < _ops.size(); i++)
+                {
+                    MetricsClock::time_point start = MetricsClock::now();
+                    _ops[i]->operation();
+                    if (k >= warmUp) histograms[i].record(elapsedNanoseconds(start, MetricsClock::now()));
+                }
+            }
+            for (size_t i = 0; i < _ops.size(); i++)
+            {
+                _ops[i]->input(nullptr);    // The links are local, and the Executers connect their own
+                _ops[i]->output(nullptr);
+                _costs[i] = histograms[i].snapshot().p50;
+            }
+            _partition = balance(_costs, _threads);
+        };
+
+        // Takes the times measured by the Executers of a running or finished pipeline, and
+        // changes the partition if the slowest stage would be faster by more than the tolerance.
+        // True if the partition has changed.
+        bool update(const vector<StageStats> & stats, double tolerance = 0.1)
+        {
+            for (size_t i = 0; i < _ops.size(); i++)
+            {
+                for (const StageStats & stage : stats)
+                {
+                    for (size_t j = 0; j < stage.operatorNames.size(); j++)
+                    {
+                        if ((stage.operatorNames[j] == _ops[i]->name()) && (stage.operators[j].count > 0))
+                        {
+                            _costs[i] = stage.operators[j].p50;
+                        }
+                    }
+                }
+            }
+            _partition.bottleneck = bottleneck(_costs, _partition.firsts);
+            Partition best = balance(_costs, _threads);
+            if (_partition.bottleneck <= best.bottleneck * (1.0 + tolerance)) return false;
+            _partition = best;
+            return true;
+        };
+
+        // Adds one stage for each part of the partition to a pipeline that is being built. The
+        // stages are named after the chain, with the number of the stage.
+        PipelineStage<T> build(PipelineStage<T> stage, BufferKind kind = BufferKind::Unique)
+        {
+            for (size_t s = 0; s < _partition.stages(); s++)
+            {
+                size_t end = (s + 1 < _partition.stages()) ? _partition.firsts[s + 1] : _ops.size();
+                vector<Operator<T, T> *> ops(_ops.begin() + _partition.firsts[s], _ops.begin() + end);
+                stage = stage.chain(_cname + "_" + to_string(s), ops, kind);
+            }
+            return stage;
+        };
+
+        const vector<uint64_t> & costs() const
+        {
+            return _costs;
+        };
+        const Partition & partition() const
+        {
+            return _partition;
+        };
+
+    private:
+        string _cname;                      // Name of the chain, and of its stages
+        vector<Operator<T, T> *> _ops;      // In order of execution, owned by the caller
+        size_t _threads;                    // Number of stages to divide the chain into
+        vector<uint64_t> _costs;            // Median time per item of each operator, in ns
+        Partition _partition;
+    };
+}
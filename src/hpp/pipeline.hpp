@@ -0,0 +1,315 @@
+/*************************************************************************************
+ * A pipeline keeps the Executers of one chain, from the source to the sink, and starts
+ * and ends them together. The Executers are created, connected and given their operators
+ * as before, and are then added in order:
+ *
+ *      Pipeline pipeline("FaceDetection");
+ *      pipeline.add(readerThread).add(detectorThread).add(writerThread);
+ *      pipeline.start();
+ *      pipeline.drain();
+ *
+ * There are two ways to end a pipeline without losing data in flight:
+ *
+ *      1. drain() waits until the stream has ended by itself, i.e. the source has reported
+ *          that it is complete, and the end of the stream has passed all Executers.
+ *      2. finish() requests the source to end the stream after its current item, and then
+ *          drains the pipeline in the same way.
+ *
+ * Both return as soon as the sink has consumed the last item, without any waiting time.
+ * stop() ends all Executers at once, and the items in flight are dropped. report() prints
+ * the latency histograms of all Executers, to find the stage that limits the throughput,
+ * and stats() gives the same numbers per stage to the program.
+ *
+ * Instead of creating and connecting the Executers by hand, the pipeline can build them
+ * from the operators, with one Executer per operator, in order from the source to the sink:
+ *
+ *      Pipeline pipeline("FaceDetection");
+ *      pipeline.source(reader)
+ *              .stage("Detectors", detectors)                  // Replicated, one per operator
+ *              .stage(eyes, BufferKind::Spsc)
+ *              .sink(writer);
+ *
+ * The types of the operators are checked at compile time, so that an operator can only
+ * follow one that delivers its input type. The kind of the buffer in front of each stage
+ * is chosen with BufferKind. chain() runs several operators of the same type in one stage,
+ * see also partitioner.hpp. The Executers and the buffers that are built in this way are
+ * owned by the pipeline.
+ *
+ * Each Executer keeps and joins its own threads, so several pipelines can run in the same
+ * process and be started, drained and stopped independently of each other.
+ *
+*************************************************************************************/
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+
+#include <opsexecuter.hpp>
+#include <replicatedexecuter.hpp>
+#include <uniquebuffer.hpp>
+#include <ringbuffer.hpp>
+#include <spscbuffer.hpp>
+#include <conflatingbuffer.hpp>
+
+using namespace std;
+
+namespace parallelOperators
+{
+    // The buffers that the builder can place in front of a stage.
+    enum BufferKind
+    {
+        Unique = 0,                         // One slot, the sender waits for the receiver
+        Ring,                               // A few slots, to absorb variations in time
+        Spsc,                               // A few slots, lock-free
+        Conflating                          // One slot, the newest item replaces an unread one
+    };
+
+    // Times of one stage, as recorded by its Executer.
+    struct StageStats
+    {
+        string name;
+        LatencySnapshot compute;            // All operators together, per item
+        LatencySnapshot receiveWait;        // Blocked in receive, waiting for input
+        LatencySnapshot sendWait;           // Blocked in send, waiting for space
+        uint64_t threadCpu {0};             // CPU time of the thread, when it has ended
+        uint64_t threadWall {0};            // Wall time of the thread, when it has ended
+        vector<string> operatorNames;       // In order of execution
+        vector<LatencySnapshot> operators;  // Compute time per operator, same order
+    };
+
+    template <class T>
+    class PipelineStage;
+
+    class Pipeline
+    {
+    public:
+        Pipeline(string pname = "Pipeline"): _pname(pname) {};
+
+        // A pipeline that is left while it runs, e.g. on an exception, is stopped, so that its
+        // threads have ended before the Executers are destroyed.
+        ~Pipeline()
+        {
+            if (_running) stop();
+        };
+
+        static constexpr size_t bufferSlots = 8;    // Slots of the Ring and Spsc buffers of the builder
+
+        // The first stage of a pipeline that is built from operators. The pipeline is then
+        // continued with stage() and completed with sink() on the returned object.
+        template <class T_OUT>
+        PipelineStage<T_OUT> source(SourceOperator<T_OUT> & op);
+
+        // Executers are added in order, from the source to the sink.
+        Pipeline & add(BaseExecuter & executer)
+        {
+            _executers.emplace_back(&executer);
+            return *this;
+        };
+
+        // All Executers are set to the given mode and started in their own threads.
+        void start(ExecutionMode mode = ExecutionMode::Continuous)
+        {
+#ifdef DEBUG_PRINTOUT
+            cout << " **) Starting the pipeline  - " << _pname << "   \n";
+#endif
+            _running = true;
+            for (BaseExecuter * executer : _executers)
+            {
+                executer->send(ExecutionMode(mode));
+                executer->startThread();
+            }
+        };
+
+        // Waits until the end of the stream has passed all Executers, and joins their threads.
+        void drain()
+        {
+            for (BaseExecuter * executer : _executers) executer->waitToEnd();
+            for (BaseExecuter * executer : _executers) executer->join();
+            _running = false;
+#ifdef DEBUG_PRINTOUT
+            cout << " **) The pipeline is drained  - " << _pname << "   \n";
+#endif
+        };
+
+        // Ends the stream at the source and waits until the pipeline is drained.
+        void finish()
+        {
+            if (!_executers.empty()) _executers.front()->finish();
+            drain();
+        };
+
+        // Latency histograms of all Executers, in order from the source to the sink.
+        void report(ostream & os) const
+        {
+            for (BaseExecuter * executer : _executers) executer->report(os);
+        };
+
+        // The Executer of a stage, by its name, e.g. to give a stage that was built from its
+        // operator a placement before the start. nullptr if there is none.
+        BaseExecuter * executer(const string & ename)
+        {
+            for (BaseExecuter * executer : _executers)
+            {
+                if (executer->name() == ename) return executer;
+            }
+            return nullptr;
+        };
+
+        // The times of all Executers, in order from the source to the sink.
+        vector<StageStats> stats() const
+        {
+            vector<StageStats> all;
+            for (BaseExecuter * executer : _executers)
+            {
+                const ExecuterMetrics & metrics = executer->metrics();
+                StageStats stage;
+                stage.name = executer->name();
+                stage.compute = metrics.compute.snapshot();
+                stage.receiveWait = metrics.receiveWait.snapshot();
+                stage.sendWait = metrics.sendWait.snapshot();
+                stage.threadCpu = metrics.threadCpu.load(memory_order_relaxed);
+                stage.threadWall = metrics.threadWall.load(memory_order_relaxed);
+                stage.operatorNames = metrics.operatorNames;
+                for (auto & histogram : metrics.operators) stage.operators.emplace_back(histogram->snapshot());
+                all.emplace_back(move(stage));
+            }
+            return all;
+        };
+
+        // Ends all Executers at once, without draining.
+        void stop()
+        {
+            for (BaseExecuter * executer : _executers) executer->stop();
+            for (BaseExecuter * executer : _executers) executer->waitToEnd();
+            for (BaseExecuter * executer : _executers) executer->join();
+            _running = false;
+        };
+
+    private:
+        template <class T>
+        friend class PipelineStage;
+
+        string _pname;                      // A name to allow following the process
+        vector<BaseExecuter *> _executers;  // From the source to the sink
+        vector<unique_ptr<BaseExecuter>> _owned;    // The Executers created by the builder
+        bool _running = false;              // Started, and neither drained nor stopped
+
+        // An Executer of the builder is kept by the pipeline and added in order.
+        template <class E>
+        E & _own(unique_ptr<E> executer)
+        {
+            E & added = *executer;
+            _owned.emplace_back(move(executer));
+            add(added);
+            return added;
+        };
+
+        template <class T>
+        static shared_ptr<BaseBuffer<T>> _makeBuffer(BufferKind kind, const string & bname)
+        {
+            switch (kind)
+            {
+            case BufferKind::Ring:
+                return make_shared<RingBuffer<T, bufferSlots>>(bname);
+            case BufferKind::Spsc:
+                return make_shared<SpscBuffer<T, bufferSlots>>(bname);
+            case BufferKind::Conflating:
+                return make_shared<ConflatingBuffer<T>>(bname);
+            default:
+                return make_shared<UniqueBuffer<T>>(bname);
+            }
+        };
+    };
+
+    // The open end of a pipeline that is being built, delivering items of type T. Each call
+    // adds an Executer for the given operator, with a buffer of the given kind in front of
+    // it, and connects it to the previous Executer.
+    template <class T>
+    class PipelineStage
+    {
+    public:
+        PipelineStage(Pipeline & pipeline, function<void(shared_ptr<BaseBuffer<T>>)> connect):
+            _pipeline(&pipeline), _connect(move(connect)) {};
+
+        template <class T_OUT>
+        PipelineStage<T_OUT> stage(Operator<T, T_OUT> & op, BufferKind kind = BufferKind::Unique)
+        {
+            auto & executer = _pipeline->_own(make_unique<OperatorExecuter<T, T_OUT>>(op.name()));
+            executer.addOperator(&op);
+            executer.opInput(op.inputAddress());
+            executer.opOutput(op.outputAddress());
+            executer.input(_buffer(kind, op.name()));
+            return PipelineStage<T_OUT>(*_pipeline, [&executer](shared_ptr<BaseBuffer<T_OUT>> b) { executer.output(b); });
+        };
+
+        // A stage that runs several operators one after the other in the same thread. The
+        // operators are linked by buffers of their own, as when they are added by hand.
+        PipelineStage<T> chain(string name, const vector<Operator<T, T> *> & ops, BufferKind kind = BufferKind::Unique)
+        {
+            auto & executer = _pipeline->_own(make_unique<OperatorExecuter<T, T>>(name));
+            for (size_t i = 0; i < ops.size(); i++)
+            {
+                executer.addOperator(ops[i]);
+                if (i + 1 < ops.size())
+                {
+                    ops[i]->output(nullptr);    // A new buffer, not the one of an earlier Executer
+                    ops[i + 1]->input(ops[i]->output());
+                }
+            }
+            executer.opInput(ops.front()->inputAddress());
+            executer.opOutput(ops.back()->outputAddress());
+            executer.input(_buffer(kind, name));
+            return PipelineStage<T>(*_pipeline, [&executer](shared_ptr<BaseBuffer<T>> b) { executer.output(b); });
+        };
+
+        // A stage that is replicated, with one replica for each of the operators, which are
+        // copies of the same operator, see ReplicatedExecuter.
+        template <class OP, class T_OUT = typename OP::output_type>
+        PipelineStage<T_OUT> stage(string name, const vector<OP *> & replicas, BufferKind kind = BufferKind::Unique,
+                                   DispatchPolicy policy = DispatchPolicy::RoundRobin)
+        {
+            auto & executer = _pipeline->_own(make_unique<ReplicatedExecuter<T, T_OUT>>(name, replicas.size(), policy));
+            for (size_t i = 0; i < replicas.size(); i++)
+            {
+                executer.replica(i).addOperator(replicas[i]);
+                executer.replica(i).opInput(replicas[i]->inputAddress());
+                executer.replica(i).opOutput(replicas[i]->outputAddress());
+            }
+            executer.input(_buffer(kind, name));
+            return PipelineStage<T_OUT>(*_pipeline, [&executer](shared_ptr<BaseBuffer<T_OUT>> b) { executer.output(b); });
+        };
+
+        // The last stage, which completes the pipeline.
+        Pipeline & sink(SinkOperator<T> & op, BufferKind kind = BufferKind::Unique)
+        {
+            auto & executer = _pipeline->_own(make_unique<SinkExecuter<T>>(op.name()));
+            executer.addOperator(&op);
+            executer.opInput(op.inputAddress());
+            executer.input(_buffer(kind, op.name()));
+            return *_pipeline;
+        };
+
+    private:
+        Pipeline * _pipeline;
+        function<void(shared_ptr<BaseBuffer<T>>)> _connect;    // Sets the output of the previous Executer
+
+        // The buffer in front of the next stage, which is also the output of the previous one.
+        shared_ptr<BaseBuffer<T>> _buffer(BufferKind kind, const string & next)
+        {
+            shared_ptr<BaseBuffer<T>> buffer = Pipeline::_makeBuffer<T>(kind, next + "_input_buffer");
+            _connect(buffer);
+            return buffer;
+        };
+    };
+
+    template <class T_OUT>
+    PipelineStage<T_OUT> Pipeline::source(SourceOperator<T_OUT> & op)
+    {
+        auto & executer = _own(make_unique<SourceExecuter<T_OUT>>(op.name()));
+        executer.addOperator(&op);
+        executer.opOutput(op.outputAddress());
+        return PipelineStage<T_OUT>(*this, [&executer](shared_ptr<BaseBuffer<T_OUT>> b) { executer.output(b); });
+    }
+}
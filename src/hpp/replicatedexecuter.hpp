@@ -0,0 +1,281 @@
+/*************************************************************************************
+ * A replicated executer runs K copies of the same chain of operators in K threads, so
+ * that one heavy stage, e.g. a detector that cannot be split into smaller operators,
+ * can use more than one core.
+ *
+ * From the outside, it looks like an ordinary OperatorExecuter with one input and one
+ * output buffer. Inside, it consists of:
+ *
+ *      1. K replicas, each an OperatorExecuter with its own copy of the operators. The
+ *          replicas are available through replica(i) and are wired the same way as any
+ *          other executer, with addOperator(), opInput() and opOutput().
+ *      2. A dispatcher, running in the thread of this executer. It receives the input,
+ *          gives it a sequence number and sends it to one of the replicas, either in
+ *          round-robin order or to the replica with the least number of items in work.
+ *      3. A collector, running in its own thread. It delivers the results of the replicas
+ *          to the output buffer in the order of their sequence numbers.
+ *
+ * For each dispatched item, the dispatcher sends a ticket with the sequence number and
+ * the replica to the collector through a ring buffer. The collector follows the tickets,
+ * and since each replica processes its items in order, the results come out in the same
+ * order as they came in, regardless of which replica finishes first.
+ *
+ * At the end of the stream, the dispatcher closes the inputs of the replicas and the ticket
+ * buffer. The collector delivers the remaining results and closes the output after the last.
+ *
+ * All data is passed on by swapping, in the same way as between ordinary executers, so
+ * the replication does not add any copying.
+ *
+*************************************************************************************/
+#pragma once
+
+#include <opsexecuter.hpp>
+#include <ringbuffer.hpp>
+
+#include <thread>
+#include <vector>
+#include <future>
+
+#include <atomic>
+
+#include <iostream>
+
+using namespace std;
+
+namespace parallelOperators
+{
+    // How the dispatcher selects the replica for the next item.
+    enum DispatchPolicy
+    {
+        RoundRobin = 0,
+        LeastBusy
+    };
+
+    template <class T_IN, class T_OUT>
+    class ReplicatedExecuter : public BaseExecuter
+    {
+    public:
+        ReplicatedExecuter(string tname, size_t replicas, DispatchPolicy policy = DispatchPolicy::RoundRobin):
+                        BaseExecuter(tname), _policy(policy), _inputBuffer(make_unique<T_IN>()),
+                        _outputBuffer(make_unique<T_OUT>()), _ticket(make_unique<Ticket>()),
+                        _tickets(make_shared<RingBuffer<Ticket, maxTickets>>(tname + "_tickets")),
+                        _inWork(replicas), _futureCollectorExit(_collectorExitPromise.get_future())
+        {
+            for (size_t i = 0; i < replicas; i++)
+            {
+                _replicas.emplace_back(make_unique<OperatorExecuter<T_IN, T_OUT>>(tname + "_replica_" + to_string(i)));
+                _replicas[i]->input();      // The buffers of the replicas are created here, before they are
+                _replicas[i]->output();     // accessed from both the dispatcher/collector and the replica threads.
+                _inWork[i] = 0;
+            }
+        };
+        ~ReplicatedExecuter()
+        {
+            join();
+        };
+
+        // Access to the replicas, to add the operators and connect them, in the same way as
+        // for an OperatorExecuter.
+        OperatorExecuter<T_IN, T_OUT> & replica(size_t i)
+        {
+            return *_replicas[i];
+        };
+        size_t replicas() const
+        {
+            return _replicas.size();
+        };
+
+        // Input and output buffers, with the same alternatives as in OperatorExecuter.
+        shared_ptr <BaseBuffer<T_IN>> input()
+        {
+            if (_inputPort == nullptr) _inputPort = make_shared<UniqueBuffer<T_IN>>(_tname + "_input_buffer");
+            return _inputPort;
+        };
+        void input(shared_ptr <BaseBuffer<T_IN>> inp)
+        {
+            if (inp != nullptr)
+            {
+                if (_inputPort != nullptr) _inputPort.reset();
+                _inputPort = inp;
+            }
+        };
+        shared_ptr <BaseBuffer<T_OUT>> output()
+        {
+            if (_outputPort == nullptr) _outputPort = make_shared<UniqueBuffer<T_OUT>>(_tname + "_output_buffer");
+            return _outputPort;
+        };
+        void output(shared_ptr <BaseBuffer<T_OUT>> outp)
+        {
+            if (outp != nullptr)
+            {
+                if (_outputPort != nullptr) _outputPort.reset();
+                _outputPort = outp;
+            }
+        };
+
+        // The replicas always run continuously, the dispatcher follows the requested mode.
+        void startThread() override
+        {
+            _applyWaitPolicy();
+            for (auto & r : _replicas)
+            {
+                r->send(ExecutionMode::Continuous);
+                r->startThread();
+            }
+            _collector = thread(&ReplicatedExecuter::_collect, this, move(_collectorExitPromise));
+            BaseExecuter::startThread();
+        }
+
+        // The dispatcher and the collector wait on the replicas, so the replicated executer
+        // always runs in its own threads, also when the rest of the pipeline runs in a pool.
+        void startTask(WorkStealingPool &) override
+        {
+            startThread();
+        }
+
+        // The dispatcher records how long it waits for input and for the selected replica. The
+        // compute times are recorded by each replica.
+        void report(ostream & os) const override
+        {
+            _metrics.report(os, _tname);
+            for (auto & r : _replicas) r->report(os);
+        }
+
+        // The replicated executer has ended when the dispatcher, the collector and all replicas have ended.
+        void waitToEnd() override
+        {
+            BaseExecuter::waitToEnd();
+            _futureCollectorExit.wait();
+            for (auto & r : _replicas) r->waitToEnd();
+        }
+
+        // The collector is joined here, before the members it uses are destroyed.
+        void join() override
+        {
+            BaseExecuter::join();
+            if (_collector.joinable()) _collector.join();
+            for (auto & r : _replicas) r->join();
+        }
+
+    private:
+        // A ticket follows each item from the dispatcher to the collector.
+        struct Ticket
+        {
+            size_t sequence {0};
+            size_t replica {0};
+        };
+        static constexpr size_t maxTickets = 64;    // Maximum number of items in work in all replicas together
+
+        DispatchPolicy _policy;
+        vector<unique_ptr<OperatorExecuter<T_IN, T_OUT>>> _replicas;
+        shared_ptr<BaseBuffer<T_IN>> _inputPort = nullptr;
+        shared_ptr<BaseBuffer<T_OUT>> _outputPort = nullptr;
+        unique_ptr<T_IN> _inputBuffer;              // Used by the dispatcher
+        unique_ptr<T_OUT> _outputBuffer;            // Used by the collector
+        unique_ptr<Ticket> _ticket;                 // Used by the dispatcher
+        shared_ptr<RingBuffer<Ticket, maxTickets>> _tickets;
+        vector<atomic<size_t>> _inWork;            // Number of dispatched but not yet collected items per replica
+        size_t _nextReplica {0};
+        size_t _nextSequence {0};
+        thread _collector;
+        promise<void> _collectorExitPromise;
+        future<void> _futureCollectorExit;
+
+        void _terminateInputOutput()
+        {
+            input()->releaseAll();
+            output()->releaseAll();
+            _tickets->releaseAll();
+            for (auto & r : _replicas) r->stop();
+        }
+
+        void _applyWaitPolicy()
+        {
+            input()->receivePolicy(_waitPolicy);
+            output()->sendPolicy(_waitPolicy);
+            for (auto & r : _replicas) r->waitPolicy(_waitPolicy);
+        }
+
+        // Selection of the replica for the next item.
+        size_t _selectReplica()
+        {
+            size_t selected = _nextReplica;
+            if (_policy == DispatchPolicy::LeastBusy)
+            {
+                // Search from the next one in turn, so that equally busy replicas share the work.
+                for (size_t i = 0; i < _replicas.size(); i++)
+                {
+                    size_t candidate = (_nextReplica + i) % _replicas.size();
+                    if (_inWork[candidate].load() < _inWork[selected].load()) selected = candidate;
+                }
+            }
+            _nextReplica = (selected + 1) % _replicas.size();
+            return selected;
+        }
+
+        // The dispatcher, executed in the thread of this executer.
+        void _execute(promise<void> && exitPromise) override
+        {
+            while (!_ending.load())
+            {
+#ifdef DEBUG_PRINTOUT
+                cout << " 01) Loop starts  - " << _tname << "   \n";
+#endif
+                _waitForCommand();
+                if (!_ending.load())
+                {
+#ifdef DEBUG_PRINTOUT
+                    cout << " 04) Reading the input  - " << _tname << "   \n";
+#endif
+                    if (!_timedReceive(*input(), _inputBuffer)) break;
+                    size_t r = _selectReplica();
+                    _inWork[r]++;
+#ifdef DEBUG_PRINTOUT
+                    cout << " 06) Dispatching item " << _nextSequence << " to replica " << r << " - " << _tname << "   \n";
+#endif
+                    _timedSend(*_replicas[r]->input(), _inputBuffer);
+                    _ticket->sequence = _nextSequence++;
+                    _ticket->replica = r;
+                    _tickets->send(_ticket);
+                }
+            }
+#ifdef DEBUG_PRINTOUT
+            cout << " 07) Loop completed  - " << _tname << "   \n";
+#endif
+            for (auto & r : _replicas) r->input()->close();
+            _tickets->close();
+            _recordThreadTimes();
+            exitPromise.set_value();
+        }
+
+        // The collector, following the tickets and delivering the results in order of sequence.
+        void _collect(promise<void> && exitPromise)
+        {
+            TRACE_THREAD_NAME(_tname + "_collector");
+            nameThisThread(_tname + "_collector");
+            auto ticket = make_unique<Ticket>();
+#ifdef DEBUG_PRINTOUT
+            size_t expectedSequence = 0;
+#endif
+            while (!_ending.load())
+            {
+                if (!_tickets->receive(ticket)) break;
+#ifdef DEBUG_PRINTOUT
+                if (ticket->sequence != expectedSequence)
+                {
+                    cout << " **) Sequence " << ticket->sequence << " received, but " << expectedSequence << " expected - " << _tname << "   \n";
+                }
+                expectedSequence = ticket->sequence + 1;
+#endif
+                if (!_replicas[ticket->replica]->output()->receive(_outputBuffer)) break;
+                _inWork[ticket->replica]--;
+#ifdef DEBUG_PRINTOUT
+                cout << " 06) Delivering item " << ticket->sequence << " from replica " << ticket->replica << " - " << _tname << "   \n";
+#endif
+                output()->send(_outputBuffer);
+            }
+            output()->close();
+            exitPromise.set_value();
+        }
+    };
+}
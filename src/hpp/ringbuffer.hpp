@@ -0,0 +1,170 @@
+/**************************************************************************************
+ * Ring Buffer is the multi-slot version of the Unique Buffer. Instead of one storage, it
+ * keeps N storages in a ring, all of them allocated at construction. The producer swaps
+ * its data into the slot at the tail and the consumer swaps its data with the slot at the
+ * head, so in the same way as in the Unique Buffer, there is no copying or allocation
+ * when data is delivered.
+ *
+ * With N slots, the producer can be up to N items ahead of the consumer before it has
+ * to wait. This allows two neighbouring Executers to absorb the jitter of each other,
+ * e.g. one slow file read or one large image, without stalling the whole pipeline.
+ *
+ * As in the Unique Buffer, receive waits when all slots are empty and send waits when
+ * all slots are occupied with not yet used data. After close, the remaining items are
+ * delivered in order before receive reports the end of the stream.
+ *
+ * **************************************************************************************/
+#pragma once
+
+#include <array>
+#include <mutex>
+#include <condition_variable>
+
+#include <atomic>
+
+#include <iostream>
+
+#include <basebuffer.hpp>
+
+using namespace std;
+
+namespace parallelOperators
+{
+    template <class T, size_t N>
+    class RingBuffer : public BaseBuffer<T>
+    {
+        static_assert(N > 0, "A ring buffer needs at least one slot.");
+    public:
+        RingBuffer(string bname): BaseBuffer<T>(bname)
+        {
+            for (unique_ptr<T> & slot : _slots) slot = make_unique<T>();
+        };
+
+        // Send and receive swap with the slot at the tail and head of the ring respectively,
+        // with waiting for a free slot at send and waiting for new data at receive.
+        bool receive(unique_ptr<T> & data_ptr) override
+        {
+#ifdef DEBUG_PRINTOUT
+            cout << " **) Waiting for refreshed data from - " << _bname << "   \n";
+#endif
+            spinWait(_receivePolicy, [this] { return ((_count > 0) || _ending || _closed); });
+            unique_lock<mutex> uLock(_mutex);
+            _notEmpty.wait(uLock, [this] { return ((_count > 0) || _ending || _closed); });
+            if (_count == 0) return false;          // End of stream, or released
+#ifdef DEBUG_PRINTOUT
+            cout << " **) New data has arrived and now, the data can now be swaped at - " << _bname << "   \n";
+#endif
+            _slots[_head].swap(data_ptr);
+            _head = (_head + 1) % N;
+            _count--;
+            _notFull.notify_one();
+            uLock.unlock();
+            this->_notifySpace();
+            return true;
+        };
+        void send(unique_ptr<T> & data_ptr) override
+        {
+#ifdef DEBUG_PRINTOUT
+            cout << " **) Waiting for a slot to become available - " << _bname << "   \n";
+#endif
+            spinWait(_sendPolicy, [this] { return ((_count < N) || _ending); });
+            unique_lock<mutex> uLock(_mutex);
+            _notFull.wait(uLock, [this] { return ((_count < N) || _ending); });
+#ifdef DEBUG_PRINTOUT
+            cout << " **) A slot is available and data can now be swaped at - " << _bname << "   \n";
+#endif
+            if (_count < N)
+            {
+                _slots[_tail].swap(data_ptr);
+                _tail = (_tail + 1) % N;
+                _count++;
+            }
+            _notEmpty.notify_one();
+            uLock.unlock();
+            this->_notifyData();
+        }
+
+        // The same exchanges as above, but without waiting.
+        bool tryReceive(unique_ptr<T> & data_ptr) override
+        {
+            unique_lock<mutex> uLock(_mutex);
+            if (_count == 0) return false;
+            _slots[_head].swap(data_ptr);
+            _head = (_head + 1) % N;
+            _count--;
+            _notFull.notify_one();
+            uLock.unlock();
+            this->_notifySpace();
+            return true;
+        }
+        bool trySend(unique_ptr<T> & data_ptr) override
+        {
+            unique_lock<mutex> uLock(_mutex);
+            if (_count == N) return false;
+            _slots[_tail].swap(data_ptr);
+            _tail = (_tail + 1) % N;
+            _count++;
+            _notEmpty.notify_one();
+            uLock.unlock();
+            this->_notifyData();
+            return true;
+        }
+
+        // The end of the stream is marked behind the items that are still in the ring.
+        void close() override
+        {
+#ifdef DEBUG_PRINTOUT
+            cout << " **) End of stream - " << _bname << "   \n";
+#endif
+            {
+                lock_guard<mutex> uLock(_mutex);
+                _closed = true;
+                _notEmpty.notify_all();
+            }
+            this->_notifyData();
+        }
+        bool endOfStream() override
+        {
+            return (_closed && (_count == 0));
+        }
+
+        // When an ending reques has come, the locks need to be release.
+        void releaseAll() override
+        {
+#ifdef DEBUG_PRINTOUT
+            cout << " **) Request to end and release mutex - " << _bname << "   \n";
+#endif
+            {
+                lock_guard<mutex> uLock(_mutex);
+                _ending = true;
+                _notEmpty.notify_all();
+                _notFull.notify_all();
+            }
+            this->_notifyData();
+            this->_notifySpace();
+        }
+
+        // Number of slots, i.e. how many items the producer can be ahead of the consumer.
+        static constexpr size_t depth() { return N; };
+
+        void allocateSlots() override
+        {
+            lock_guard<mutex> uLock(_mutex);
+            for (size_t i = _count; i < N; i++) _slots[(_tail + i - _count) % N] = make_unique<T>();
+        }
+
+    private:
+        using BaseBuffer<T>::_bname;
+        using BaseBuffer<T>::_sendPolicy;
+        using BaseBuffer<T>::_receivePolicy;
+        mutex _mutex;                               // Data protection
+        condition_variable _notEmpty;               // Waiting for new data at receive
+        condition_variable _notFull;                // Waiting for a free slot at send
+        array<unique_ptr<T>, N> _slots;             // Data storages, all allocated at construction
+        size_t _head {0};                           // Next slot to be delivered to the consumer
+        size_t _tail {0};                           // Next slot to be filled by the producer
+        atomic<size_t> _count {0};                  // Number of slots with not yet used data, also read while spinning
+        atomic_bool _ending = false;
+        atomic_bool _closed = false;                // The producer has sent its last item
+    };
+}
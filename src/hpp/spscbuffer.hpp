@@ -0,0 +1,179 @@
+/**************************************************************************************
+ * SPSC Buffer is a lock-free alternative to the Unique Buffer. Every link between two
+ * Executers has exactly one producer and one consumer, and with this restriction the
+ * exchange of data can be synchronized with two atomic counters instead of a mutex and
+ * a condition variable:
+ *
+ *      head: the number of items taken by the consumer, written only by the consumer.
+ *      tail: the number of items delivered by the producer, written only by the producer.
+ *
+ * The buffer has N slots, all allocated at construction. The producer swaps its data
+ * into slot tail % N and then publishes it by incrementing tail. The consumer swaps its
+ * data with slot head % N and then frees the slot by incrementing head. As in the Unique
+ * Buffer, the delivery of data is only exchange of addresses and no copying will take place.
+ *
+ * head and tail are placed on separate cache lines, and each side keeps a private copy
+ * of the other side's counter, so that the two threads do not invalidate each other's
+ * cache lines as long as there is no need for synchronization.
+ *
+ * Since the buffer is meant for fast hand-off, the default wait policy is SpinYield. When
+ * a thread has to block, it sleeps on a Waiter, which is only notified if somebody sleeps.
+ *
+ * The buffer must only be used with one sending and one receiving thread. With N = 1, it
+ * behaves as the Unique Buffer and can replace it directly.
+ *
+ * **************************************************************************************/
+#pragma once
+
+#include <array>
+
+#include <atomic>
+
+#include <iostream>
+
+#include <basebuffer.hpp>
+#include <waitpolicy.hpp>
+
+using namespace std;
+
+namespace parallelOperators
+{
+    // Size of a cache line, used to keep data written by different threads apart.
+    constexpr size_t cacheLineSize = 64;
+
+    template <class T, size_t N = 1>
+    class SpscBuffer : public BaseBuffer<T>
+    {
+        static_assert(N > 0, "An SPSC buffer needs at least one slot.");
+    public:
+        SpscBuffer(string bname): BaseBuffer<T>(bname)
+        {
+            this->waitPolicy(WaitPolicy::SpinYield);
+            for (unique_ptr<T> & slot : _slots) slot = make_unique<T>();
+        };
+
+        // Receive waits until the producer has published a slot, swaps it and frees it.
+        bool receive(unique_ptr<T> & data_ptr) override
+        {
+            size_t head = _head.load(memory_order_relaxed);
+#ifdef DEBUG_PRINTOUT
+            cout << " **) Waiting for refreshed data from - " << _bname << "   \n";
+#endif
+            if (head == _cachedTail)
+            {
+                _notEmpty.wait(_receivePolicy, [this, head] { return ((_tail.load(memory_order_acquire) != head) ||
+                                                                       _ending.load() || _closed.load(memory_order_acquire)); });
+                _cachedTail = _tail.load(memory_order_acquire);
+                if (head == _cachedTail) return false;  // End of stream, or released without new data
+            }
+#ifdef DEBUG_PRINTOUT
+            cout << " **) New data has arrived and now, the data can now be swaped at - " << _bname << "   \n";
+#endif
+            _slots[head % N].swap(data_ptr);
+            _head.store(head + 1, memory_order_release);
+            _notFull.notify();
+            this->_notifySpace();
+            return true;
+        };
+
+        // Send waits until a slot is free, swaps the data into it and publishes it.
+        void send(unique_ptr<T> & data_ptr) override
+        {
+            size_t tail = _tail.load(memory_order_relaxed);
+#ifdef DEBUG_PRINTOUT
+            cout << " **) Waiting for the buffer to become available - " << _bname << "   \n";
+#endif
+            if (tail - _cachedHead == N)
+            {
+                _notFull.wait(_sendPolicy, [this, tail] { return ((tail - _head.load(memory_order_acquire) != N) || _ending.load()); });
+                _cachedHead = _head.load(memory_order_acquire);
+                if (tail - _cachedHead == N) return;    // Released without free slot
+            }
+#ifdef DEBUG_PRINTOUT
+            cout << " **) Buffer is available and data can now be swaped at - " << _bname << "   \n";
+#endif
+            _slots[tail % N].swap(data_ptr);
+            _tail.store(tail + 1, memory_order_release);
+            _notEmpty.notify();
+            this->_notifyData();
+        }
+
+        // The same exchanges as above, but without waiting.
+        bool tryReceive(unique_ptr<T> & data_ptr) override
+        {
+            size_t head = _head.load(memory_order_relaxed);
+            if (head == _cachedTail)
+            {
+                _cachedTail = _tail.load(memory_order_acquire);
+                if (head == _cachedTail) return false;
+            }
+            _slots[head % N].swap(data_ptr);
+            _head.store(head + 1, memory_order_release);
+            _notFull.notify();
+            this->_notifySpace();
+            return true;
+        }
+        bool trySend(unique_ptr<T> & data_ptr) override
+        {
+            size_t tail = _tail.load(memory_order_relaxed);
+            if (tail - _cachedHead == N)
+            {
+                _cachedHead = _head.load(memory_order_acquire);
+                if (tail - _cachedHead == N) return false;
+            }
+            _slots[tail % N].swap(data_ptr);
+            _tail.store(tail + 1, memory_order_release);
+            _notEmpty.notify();
+            this->_notifyData();
+            return true;
+        }
+
+        // The end of the stream is published after the last item, by the producer. Since the
+        // tail is written before the flag, a consumer that sees the flag also sees all items.
+        void close() override
+        {
+            _closed.store(true, memory_order_release);
+            _notEmpty.notify();
+            this->_notifyData();
+        }
+        bool endOfStream() override
+        {
+            return (_closed.load(memory_order_acquire) && (_head.load(memory_order_relaxed) == _tail.load(memory_order_acquire)));
+        }
+
+        // When an ending reques has come, the waiting threads observe the flag and return.
+        void releaseAll() override
+        {
+#ifdef DEBUG_PRINTOUT
+            cout << " **) Request to end and release waiting threads - " << _bname << "   \n";
+#endif
+            _ending.store(true);
+            _notEmpty.notify();
+            _notFull.notify();
+            this->_notifyData();
+            this->_notifySpace();
+        }
+
+        // The free slots are only touched by the producer, which is the calling thread.
+        void allocateSlots() override
+        {
+            size_t tail = _tail.load(memory_order_relaxed);
+            size_t head = _head.load(memory_order_acquire);
+            for (size_t i = tail; i < head + N; i++) _slots[i % N] = make_unique<T>();
+        }
+
+    private:
+        using BaseBuffer<T>::_bname;
+        using BaseBuffer<T>::_sendPolicy;
+        using BaseBuffer<T>::_receivePolicy;
+        array<unique_ptr<T>, N> _slots;                         // Data storages, all allocated at construction
+        alignas(cacheLineSize) atomic<size_t> _head {0};        // Written by the consumer only
+        size_t _cachedTail {0};                                 // Consumer's copy of the tail
+        alignas(cacheLineSize) atomic<size_t> _tail {0};        // Written by the producer only
+        size_t _cachedHead {0};                                 // Producer's copy of the head
+        alignas(cacheLineSize) atomic_bool _ending = false;
+        atomic_bool _closed = false;                            // Written by the producer after the last item
+        Waiter _notEmpty;                                       // Blocking of the consumer, only used when
+        Waiter _notFull;                                        // the wait policy lets the thread sleep
+    };
+}
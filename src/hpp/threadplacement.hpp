@@ -0,0 +1,115 @@
+/*************************************************************************************
+ * Thread placement decides where and how urgently the thread of an Executer runs. By
+ * default, the kernel may move a thread between cores and sockets at any time, and two
+ * busy stages may share a core while another one is idle. A ThreadPlacement is given to
+ * an Executer before it is started, and is applied by the thread itself when it starts:
+ *
+ *      1. cpus: the CPUs the thread may run on, with pthread_setaffinity_np(). Adjacent
+ *          stages can be kept on CPUs that share a cache, see cacheSiblings(), so that
+ *          an item is still in the cache when the next stage receives it.
+ *      2. policy and priority: SCHED_FIFO or SCHED_RR with a priority from 1 to 99, so that
+ *          a stage with a deadline, e.g. the capture of a camera, is not delayed by other
+ *          work. Real-time policies usually need CAP_SYS_NICE.
+ *      3. localMemory: the thread allocates its working data and the free slots of its
+ *          output buffer again, after the affinity is set. Linux places a page on the NUMA
+ *          node of the thread that first writes to it, so the data that the stage writes
+ *          comes from memory that is local to its CPUs, without any NUMA library.
+ *
+ * A placement that cannot be applied, e.g. a real-time policy without the permission,
+ * is reported on the console and the thread runs with what could be applied.
+ *
+ * The placement only applies to Executers with a thread of their own. A task in a pool
+ * runs on the workers of the pool.
+ *
+*************************************************************************************/
+#pragma once
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
+
+using namespace std;
+
+namespace parallelOperators
+{
+    struct ThreadPlacement
+    {
+        vector<int> cpus;                   // CPUs the thread may run on, any if empty
+        int policy = SCHED_OTHER;           // SCHED_FIFO or SCHED_RR for real-time priority
+        int priority = 0;                   // 1 to 99 with a real-time policy
+        bool localMemory = false;           // Allocate the data of the stage in its own thread
+    };
+
+    // Applies the placement to the calling thread. Returns 0, or the error of the first call
+    // that failed.
+    inline int placeThisThread(const ThreadPlacement & placement)
+    {
+        int result = 0;
+        if (!placement.cpus.empty())
+        {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            for (int cpu : placement.cpus) CPU_SET(cpu, &set);
+            result = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        }
+        if (placement.policy != SCHED_OTHER)
+        {
+            sched_param parameter{};
+            parameter.sched_priority = placement.priority;
+            int error = pthread_setschedparam(pthread_self(), placement.policy, &parameter);
+            if (result == 0) result = error;
+        }
+        return result;
+    }
+
+    // A list of CPUs in the format of the kernel, e.g. "0-3,8,10-11".
+    inline vector<int> parseCpuList(const string & list)
+    {
+        vector<int> cpus;
+        stringstream ranges(list);
+        string range;
+        while (getline(ranges, range, ','))
+        {
+            if (range.empty() || (range == "\n")) continue;
+            size_t dash = range.find('-');
+            int first = stoi(range.substr(0, dash));
+            int last = (dash == string::npos) ? first : stoi(range.substr(dash + 1));
+            for (int cpu = first; cpu <= last; cpu++) cpus.emplace_back(cpu);
+        }
+        return cpus;
+    }
+
+    // The CPUs that share the cache of the given level with a CPU, including itself, e.g.
+    // the cores of the same L3. Only the CPU itself if the kernel does not tell.
+    inline vector<int> cacheSiblings(int cpu, int level = 3)
+    {
+        string cacheDirectory = "/sys/devices/system/cpu/cpu" + to_string(cpu) + "/cache/";
+        for (int index = 0; index < 8; index++)
+        {
+            string directory = cacheDirectory + "index" + to_string(index) + "/";
+            ifstream levelFile(directory + "level");
+            if (!levelFile) break;
+            int cacheLevel = 0;
+            levelFile >> cacheLevel;
+            if (cacheLevel != level) continue;
+            ifstream listFile(directory + "shared_cpu_list");
+            string list;
+            if (getline(listFile, list)) return parseCpuList(list);
+        }
+        return {cpu};
+    }
+
+    // The CPUs of a NUMA node, none if the node does not exist.
+    inline vector<int> nodeCpus(int node)
+    {
+        ifstream listFile("/sys/devices/system/node/node" + to_string(node) + "/cpulist");
+        string list;
+        if (!getline(listFile, list)) return {};
+        return parseCpuList(list);
+    }
+}
@@ -0,0 +1,205 @@
+/**************************************************************************************
+ * The work-stealing pool is an alternative to running every Executer in its own thread.
+ * A fixed number of worker threads, normally one per core, execute small tasks. Each
+ * worker has its own queue of tasks:
+ *
+ *      1. A task submitted from a worker is put at the back of the worker's own queue,
+ *          and the worker takes its next task from the back as well, so that the data
+ *          that was just produced is still in the cache when it is consumed.
+ *      2. A task submitted from outside the pool is distributed over the queues in turn.
+ *      3. A worker with an empty queue steals the oldest task from the front of the
+ *          queue of another worker before it goes to sleep.
+ *
+ * Executers use the pool through startTask(). Instead of blocking a thread while they
+ * wait for data or for space in a buffer, they return and are submitted again when the
+ * buffer reports that they can continue. A pipeline with many small stages can then run
+ * on as many threads as there are cores.
+ *
+ * An operator can also split its own work over the pool with parallelFor(), e.g. one
+ * image in tiles. The calling thread takes part in the work, so that it can be called
+ * both from an Executer thread and from a worker of the pool.
+ *
+ * **************************************************************************************/
+#pragma once
+
+#include <thread>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+
+#include <atomic>
+
+#include <iostream>
+
+#include <tracer.hpp>
+#include <metrics.hpp>
+
+using namespace std;
+
+namespace parallelOperators
+{
+    class WorkStealingPool
+    {
+    public:
+        WorkStealingPool(size_t workers = thread::hardware_concurrency())
+        {
+            if (workers == 0) workers = 1;
+            for (size_t i = 0; i < workers; i++) _queues.emplace_back(make_unique<TaskQueue>());
+            for (size_t i = 0; i < workers; i++) _threads.emplace_back(thread(&WorkStealingPool::_run, this, i));
+        };
+        ~WorkStealingPool()
+        {
+            {
+                lock_guard<mutex> uLock(_mutex);
+                _ending = true;
+                _condition.notify_all();
+            }
+            for (thread & t : _threads)
+            {
+                if (t.joinable()) t.join();
+            }
+        };
+
+        // Adds a task to the queue of the calling worker, or to the next queue in turn when
+        // called from outside the pool.
+        void submit(function<void()> task)
+        {
+            size_t index = (_currentPool == this) ? _currentWorker : (_nextQueue++ % _queues.size());
+            {
+                lock_guard<mutex> qLock(_queues[index]->_mutex);
+                _queues[index]->_tasks.emplace_back(move(task));
+            }
+            _pending++;
+            if (_sleepers.load() > 0)
+            {
+                lock_guard<mutex> uLock(_mutex);
+                _condition.notify_one();
+            }
+        };
+
+        size_t workers() const
+        {
+            return _queues.size();
+        };
+
+        // Runs job(0) to job(count - 1) in the workers and in the calling thread, and returns
+        // when all of them have been completed. Each index is taken by the first thread that
+        // comes to it, so a slow job does not hold up the others.
+        void parallelFor(size_t count, function<void(size_t)> job)
+        {
+            if (count == 0) return;
+            auto jobs = make_shared<ParallelJobs>(count, move(job));
+            size_t helpers = min(count - 1, _queues.size());
+            for (size_t i = 0; i < helpers; i++) submit([jobs] { jobs->work(); });
+            jobs->work();
+            unique_lock<mutex> uLock(jobs->_mutex);
+            jobs->_condition.wait(uLock, [&jobs] { return (jobs->_done.load() == jobs->_count); });
+        };
+
+    private:
+        struct TaskQueue
+        {
+            mutex _mutex;
+            deque<function<void()>> _tasks;
+        };
+
+        // Shared by the threads of one parallelFor(). Helpers that start after all indices
+        // have been taken return at once, also if the caller has already returned.
+        struct ParallelJobs
+        {
+            ParallelJobs(size_t count, function<void(size_t)> job): _count(count), _job(move(job)) {};
+            void work()
+            {
+                for (size_t i = _next++; i < _count; i = _next++)
+                {
+                    _job(i);
+                    if (++_done == _count)
+                    {
+                        lock_guard<mutex> uLock(_mutex);
+                        _condition.notify_all();
+                    }
+                }
+            };
+            size_t _count;                          // Number of indices
+            function<void(size_t)> _job;
+            atomic<size_t> _next {0};               // Next index to be taken
+            atomic<size_t> _done {0};               // Number of completed indices
+            mutex _mutex;                           // Only for the waiting caller
+            condition_variable _condition;
+        };
+
+        vector<unique_ptr<TaskQueue>> _queues;      // One queue per worker
+        vector<thread> _threads;                    // The workers
+        mutex _mutex;                               // Only used for sleeping workers
+        condition_variable _condition;
+        atomic<size_t> _pending {0};                // Number of tasks in all queues
+        atomic<size_t> _sleepers {0};               // Number of sleeping workers
+        atomic<size_t> _nextQueue {0};              // For distribution of tasks from outside
+        bool _ending = false;
+
+        // Identification of the worker that runs in the current thread.
+        inline static thread_local WorkStealingPool * _currentPool = nullptr;
+        inline static thread_local size_t _currentWorker = 0;
+
+        // Takes a task from the back of the own queue, or steals from the front of another.
+        bool _take(size_t index, function<void()> & task)
+        {
+            {
+                lock_guard<mutex> qLock(_queues[index]->_mutex);
+                if (!_queues[index]->_tasks.empty())
+                {
+                    task = move(_queues[index]->_tasks.back());
+                    _queues[index]->_tasks.pop_back();
+                    return true;
+                }
+            }
+            for (size_t i = 1; i < _queues.size(); i++)
+            {
+                TaskQueue & victim = *_queues[(index + i) % _queues.size()];
+                lock_guard<mutex> qLock(victim._mutex);
+                if (!victim._tasks.empty())
+                {
+                    task = move(victim._tasks.front());
+                    victim._tasks.pop_front();
+                    return true;
+                }
+            }
+            return false;
+        };
+
+        // The loop of each worker thread.
+        void _run(size_t index)
+        {
+            _currentPool = this;
+            _currentWorker = index;
+            TRACE_THREAD_NAME("Worker_" + to_string(index));
+            nameThisThread("Worker_" + to_string(index));
+            function<void()> task;
+            while (true)
+            {
+                if (_take(index, task))
+                {
+                    _pending--;
+                    task();
+                    continue;
+                }
+                unique_lock<mutex> uLock(_mutex);
+                if (_ending) break;
+                if (_pending.load() > 0)
+                {
+                    // A task is on its way into or out of a queue, try again.
+                    uLock.unlock();
+                    this_thread::yield();
+                    continue;
+                }
+                _sleepers++;
+                _condition.wait(uLock, [this] { return ((_pending.load() > 0) || _ending); });
+                _sleepers--;
+            }
+        };
+    };
+}
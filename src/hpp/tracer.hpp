@@ -0,0 +1,227 @@
+/*************************************************************************************
+ * The tracer records a timeline of the execution, to see how the Executers overlap in
+ * time: when a stage is blocked by its neighbour, how long each item takes in each stage,
+ * and where the bubbles are. It is compiled in only when PIPELINE_TRACE is defined, e.g.
+ *
+ *      cmake -DCMAKE_CXX_FLAGS=-DPIPELINE_TRACE ..
+ *
+ * Otherwise, all TRACE_ macros expand to nothing and the hot loops are unaffected.
+ *
+ * When enabled, the following is recorded:
+ *
+ *      1. the time of every operation() call, with the name of the operator,
+ *      2. the time every Executer is blocked in receive and send, with the name of the buffer,
+ *      3. the names of the threads, i.e. the Executers and the workers of the pool.
+ *
+ * Every thread writes its events to a buffer of its own, so recording needs neither a
+ * lock nor an atomic read-modify-write. The size of the buffer is published with a
+ * release store, so the events can be dumped at any time. When a buffer is full, new
+ * events of that thread are counted as dropped.
+ *
+ * TRACE_DUMP(file) writes the events in the Chrome trace-event format, which can be
+ * opened in Perfetto (ui.perfetto.dev) or in chrome://tracing.
+ *
+ * Names are given as const char *, which must stay valid until the dump. Names that are
+ * built at run time are kept with TRACE_INTERN(name), which is meant for the set up and
+ * not for the hot loop.
+ *
+*************************************************************************************/
+#pragma once
+
+#ifdef PIPELINE_TRACE
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_set>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <fstream>
+
+#include <atomic>
+
+#include <iostream>
+
+using namespace std;
+
+namespace parallelOperators
+{
+    // One complete event, with its start and duration in nanoseconds from the start of the tracer.
+    struct TraceEvent
+    {
+        const char * name;
+        const char * category;
+        uint64_t start;
+        uint64_t duration;
+    };
+
+    // Events of one thread. Only the owner thread writes.
+    class TraceBuffer
+    {
+    public:
+        static constexpr size_t capacity = 1 << 16;         // Events per thread
+
+        TraceBuffer(int tid): _tid(tid)
+        {
+            _events.resize(capacity);
+        };
+
+        void add(const TraceEvent & event)
+        {
+            size_t size = _size.load(memory_order_relaxed);
+            if (size == capacity)
+            {
+                _dropped.fetch_add(1, memory_order_relaxed);
+                return;
+            }
+            _events[size] = event;
+            _size.store(size + 1, memory_order_release);
+        };
+
+    private:
+        friend class Tracer;
+        int _tid;                                   // Thread id in the trace
+        string _threadName;
+        vector<TraceEvent> _events;                 // Allocated once, at the first event of the thread
+        atomic<size_t> _size {0};                   // Number of written events
+        atomic<size_t> _dropped {0};                // Events that did not fit
+    };
+
+    class Tracer
+    {
+    public:
+        static Tracer & instance()
+        {
+            static Tracer tracer;
+            return tracer;
+        };
+
+        // Keeps a copy of the name for the lifetime of the program.
+        const char * intern(const string & name)
+        {
+            lock_guard<mutex> uLock(_mutex);
+            return _names.insert(name).first->c_str();
+        };
+
+        // The buffer of the calling thread, created at its first event.
+        TraceBuffer & local()
+        {
+            if (_local == nullptr)
+            {
+                lock_guard<mutex> uLock(_mutex);
+                _buffers.emplace_back(make_unique<TraceBuffer>((int) _buffers.size() + 1));
+                _local = _buffers.back().get();
+            }
+            return *_local;
+        };
+
+        void nameThread(const string & name)
+        {
+            TraceBuffer & buffer = local();
+            lock_guard<mutex> uLock(_mutex);
+            buffer._threadName = name;
+        };
+
+        uint64_t now() const
+        {
+            return (uint64_t) chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - _epoch).count();
+        };
+
+        // Writes all events recorded so far in the Chrome trace-event format.
+        void dump(ostream & os)
+        {
+            lock_guard<mutex> uLock(_mutex);
+            os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+            bool first = true;
+            size_t dropped = 0;
+            for (auto & buffer : _buffers)
+            {
+                if (!buffer->_threadName.empty())
+                {
+                    os << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->_tid
+                       << ",\"args\":{\"name\":\"" << _escape(buffer->_threadName) << "\"}}";
+                    first = false;
+                }
+                size_t size = buffer->_size.load(memory_order_acquire);
+                for (size_t i = 0; i < size; i++)
+                {
+                    const TraceEvent & e = buffer->_events[i];
+                    os << (first ? "" : ",\n") << "{\"name\":\"" << _escape(e.name) << "\",\"cat\":\"" << e.category
+                       << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->_tid
+                       << ",\"ts\":" << e.start / 1000 << "." << _threeDigits(e.start % 1000)
+                       << ",\"dur\":" << e.duration / 1000 << "." << _threeDigits(e.duration % 1000) << "}";
+                    first = false;
+                }
+                dropped += buffer->_dropped.load(memory_order_relaxed);
+            }
+            os << "\n]}\n";
+            if (dropped > 0) cout << " **) " << dropped << " trace events did not fit in the buffers and were dropped.\n";
+        };
+        bool dump(const string & fileName)
+        {
+            ofstream file(fileName);
+            if (!file) return false;
+            dump(file);
+            return true;
+        };
+
+    private:
+        Tracer(): _epoch(chrono::steady_clock::now()) {};
+
+        mutex _mutex;                               // Only for registration, naming and dumping
+        unordered_set<string> _names;               // Interned names
+        vector<unique_ptr<TraceBuffer>> _buffers;   // One per thread, kept after the thread has ended
+        chrono::steady_clock::time_point _epoch;
+        inline static thread_local TraceBuffer * _local = nullptr;
+
+        static string _escape(const string & s)
+        {
+            string escaped;
+            for (char c : s)
+            {
+                if ((c == '"') || (c == '\\')) escaped += '\\';
+                escaped += c;
+            }
+            return escaped;
+        };
+        static string _threeDigits(uint64_t value)
+        {
+            string digits = to_string(value);
+            return string(3 - digits.size(), '0') + digits;
+        };
+    };
+
+    // Records the time from construction to destruction as one event.
+    class TraceScope
+    {
+    public:
+        TraceScope(const char * name, const char * category): _name(name), _category(category),
+                                                                _start(Tracer::instance().now()) {};
+        ~TraceScope()
+        {
+            Tracer & tracer = Tracer::instance();
+            tracer.local().add(TraceEvent {_name, _category, _start, tracer.now() - _start});
+        };
+    private:
+        const char * _name;
+        const char * _category;
+        uint64_t _start;
+    };
+}
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name, category) parallelOperators::TraceScope TRACE_CONCAT(_traceScope, __LINE__)((name), (category))
+#define TRACE_THREAD_NAME(name) parallelOperators::Tracer::instance().nameThread(name)
+#define TRACE_INTERN(name) parallelOperators::Tracer::instance().intern(name)
+#define TRACE_DUMP(fileName) parallelOperators::Tracer::instance().dump(string(fileName))
+
+#else
+
+#define TRACE_SCOPE(name, category)
+#define TRACE_THREAD_NAME(name)
+#define TRACE_INTERN(name)
+#define TRACE_DUMP(fileName)
+
+#endif
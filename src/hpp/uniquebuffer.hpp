@@ -24,39 +24,49 @@
 
 #include <iostream>
 
+#include <basebuffer.hpp>
+
 using namespace std;
 
 namespace parallelOperators
 {
     template <class T>
-    class UniqueBuffer
+    class UniqueBuffer : public BaseBuffer<T>
     {
     public:
-        UniqueBuffer(string bname): _buffer(make_unique<T>()), _bname (bname) {};
+        UniqueBuffer(string bname): BaseBuffer<T>(bname), _buffer(make_unique<T>()) {};
 
         // Send and receive implement the process explained above, with waiting for available buffer
         // at send and waiting for new data at receive.
-        void receive(unique_ptr<T> & data_ptr)
+        // Depending on the wait policy, the state is first checked without the lock by spinning,
+        // and the condition variable is only used if the data did not arrive in time.
+        bool receive(unique_ptr<T> & data_ptr) override
         {
-            unique_lock<mutex> uLock(_mutex);
 #ifdef DEBUG_PRINTOUT
             cout << " **) Waiting for refreshed data from - " << _bname << "   \n";
 #endif
-            _condition.wait(uLock, [this] { return (_dataRefreshed || _ending); });
+            spinWait(_receivePolicy, [this] { return (_dataRefreshed || _ending || _closed); });
+            unique_lock<mutex> uLock(_mutex);
+            _condition.wait(uLock, [this] { return (_dataRefreshed || _ending || _closed); });
+            if (!_dataRefreshed) return false;      // End of stream, or released
 #ifdef DEBUG_PRINTOUT
             cout << " **) New data has arrived and now, the data can now be swaped at - " << _bname << "   \n";
 #endif
-            if (_dataRefreshed) _buffer.swap(data_ptr);
+            _buffer.swap(data_ptr);
             _bufferAvailable = true;
             _dataRefreshed = false;
             _condition.notify_one();
+            uLock.unlock();
+            this->_notifySpace();
+            return true;
         }; 
-        void send(unique_ptr<T> & data_ptr)
+        void send(unique_ptr<T> & data_ptr) override
         {
-            unique_lock<mutex> uLock(_mutex);
 #ifdef DEBUG_PRINTOUT
             cout << " **) Waiting for the buffer to become available - " << _bname << "   \n";
 #endif
+            spinWait(_sendPolicy, [this] { return (_bufferAvailable || _ending); });
+            unique_lock<mutex> uLock(_mutex);
             _condition.wait(uLock, [this] { return (_bufferAvailable || _ending); });
 #ifdef DEBUG_PRINTOUT
             cout << " **) Buffer is available and data can now be swaped at - " << _bname << "   \n";
@@ -65,25 +75,86 @@ namespace parallelOperators
             _bufferAvailable = false;
             _dataRefreshed = true;
             _condition.notify_one();
+            uLock.unlock();
+            this->_notifyData();
+        }
+
+        // The same exchanges as above, but without waiting. False is returned if there
+        // is no new data or no available buffer.
+        bool tryReceive(unique_ptr<T> & data_ptr) override
+        {
+            unique_lock<mutex> uLock(_mutex);
+            if (!_dataRefreshed) return false;
+            _buffer.swap(data_ptr);
+            _bufferAvailable = true;
+            _dataRefreshed = false;
+            _condition.notify_one();
+            uLock.unlock();
+            this->_notifySpace();
+            return true;
+        }
+        bool trySend(unique_ptr<T> & data_ptr) override
+        {
+            unique_lock<mutex> uLock(_mutex);
+            if (!_bufferAvailable) return false;
+            _buffer.swap(data_ptr);
+            _bufferAvailable = false;
+            _dataRefreshed = true;
+            _condition.notify_one();
+            uLock.unlock();
+            this->_notifyData();
+            return true;
+        }
+
+        // The end of the stream is marked behind the data that may still be in the buffer.
+        void close() override
+        {
+#ifdef DEBUG_PRINTOUT
+            cout << " **) End of stream - " << _bname << "   \n";
+#endif
+            {
+                lock_guard<mutex> uLock(_mutex);
+                _closed = true;
+                _condition.notify_all();
+            }
+            this->_notifyData();
+        }
+        bool endOfStream() override
+        {
+            return (_closed && !_dataRefreshed);
         }
 
         // When an ending reques has come, the locks need to be release.
-        void releaseAll()
+        void releaseAll() override
         {
 #ifdef DEBUG_PRINTOUT
             cout << " **) Request to end and release mutex - " << _bname << "   \n";
 #endif
-            _ending = true;
-            _condition.notify_all();
+            {
+                lock_guard<mutex> uLock(_mutex);
+                _ending = true;
+                _condition.notify_all();
+            }
+            this->_notifyData();
+            this->_notifySpace();
+        }
+
+        void allocateSlots() override
+        {
+            lock_guard<mutex> uLock(_mutex);
+            if (_bufferAvailable && !_dataRefreshed) _buffer = make_unique<T>();
         }
 
     private:
-        string _bname;                              // A name to allow following the process
+        using BaseBuffer<T>::_bname;
+        using BaseBuffer<T>::_sendPolicy;
+        using BaseBuffer<T>::_receivePolicy;
         mutex _mutex;                               // Data protection
         condition_variable _condition;              // Condition variable for waiting
         unique_ptr<T> _buffer;                      // Data storage
         atomic_bool _bufferAvailable = true;        // States that the buffer can be in
         atomic_bool _dataRefreshed = false;  
         atomic_bool _ending = false;
+        atomic_bool _closed = false;                // The producer has sent its last item
     };
 }
@@ -0,0 +1,118 @@
+/**************************************************************************************
+ * Wait policies decide how a thread waits for a condition, e.g. for new data in a buffer
+ * or for a step command in an Executer. Going straight to a condition variable costs a
+ * system call and a wake-up by the scheduler for every item, while spinning keeps the
+ * core busy but reacts within nanoseconds. The three policies are:
+ *
+ *      Block:      Wait directly on the condition variable. Friendly to other threads
+ *                  and to the power consumption. This is the default.
+ *      SpinYield:  Spin a bounded number of times with a pause instruction, then yield
+ *                  the core a bounded number of times and finally block.
+ *      Spin:       Spin with a pause instruction until the condition is met and never
+ *                  sleep. Meant for hot stages pinned to their own core.
+ *
+ * The Waiter is a helper for waiting on conditions that are changed without a mutex, as
+ * in the lock-free buffer. It only takes the mutex and notifies when a thread is actually
+ * blocked, so that the lock-free path stays free of system calls.
+ *
+ * **************************************************************************************/
+#pragma once
+
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+#include <atomic>
+
+using namespace std;
+
+namespace parallelOperators
+{
+    enum WaitPolicy
+    {
+        Block = 0,
+        SpinYield,
+        Spin
+    };
+
+    // Number of iterations in the spinning and yielding phases of SpinYield.
+    constexpr int spinLimit = 4000;
+    constexpr int yieldLimit = 200;
+
+    // Hint to the processor that we are in a spin loop.
+    inline void cpuRelax()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+        asm volatile("yield");
+#endif
+    }
+
+    // True if the process can only run one thread at a time.
+    inline bool singleCore()
+    {
+        static const bool single = (thread::hardware_concurrency() <= 1);
+        return single;
+    }
+
+    // Spins and yields according to the policy until the condition is met. Returns true
+    // when the condition is met and false when the caller should block.
+    template <class Predicate>
+    bool spinWait(WaitPolicy policy, Predicate condition)
+    {
+        if (policy == WaitPolicy::Block) return condition();
+        // With a single core, the other thread cannot change the condition while we spin, so
+        // SpinYield goes straight to yielding.
+        int spins = ((policy == WaitPolicy::SpinYield) && singleCore()) ? 0 : spinLimit;
+        for (int i = 0; i < spins; i++)
+        {
+            if (condition()) return true;
+            cpuRelax();
+        }
+        if (policy == WaitPolicy::Spin)
+        {
+            while (!condition()) cpuRelax();
+            return true;
+        }
+        for (int i = 0; i < yieldLimit; i++)
+        {
+            if (condition()) return true;
+            this_thread::yield();
+        }
+        return condition();
+    }
+
+    //-----------------------------------------------------------------------------------
+    // Waiting on a condition that is changed by atomic operations outside of any lock.
+    class Waiter
+    {
+    public:
+        template <class Predicate>
+        void wait(WaitPolicy policy, Predicate condition)
+        {
+            if (spinWait(policy, condition)) return;
+            unique_lock<mutex> uLock(_mutex);
+            _sleepers.fetch_add(1);
+            atomic_thread_fence(memory_order_seq_cst);  // Registration must be visible before the condition is checked
+            _condition.wait(uLock, condition);
+            _sleepers.fetch_sub(1);
+        }
+
+        // To be called after the condition has been changed.
+        void notify()
+        {
+            atomic_thread_fence(memory_order_seq_cst);  // The change must be visible before the sleepers are checked
+            if (_sleepers.load(memory_order_relaxed) > 0)
+            {
+                lock_guard<mutex> uLock(_mutex);
+                _condition.notify_all();
+            }
+        }
+
+    private:
+        mutex _mutex;                       // Only used when a thread blocks
+        condition_variable _condition;
+        atomic<int> _sleepers {0};          // Number of blocked threads
+    };
+}
@@ -6,17 +6,56 @@
  *          With this source, we can test the ending process.
  *      2. CounterSink: A very simple sink that only receives the input and makes it
  *          visible through a member function getValue(). It allows to test that a chain
- *          from source to final sink functions properly.
+ *          from source to final sink functions properly. The received items are counted,
+ *          so that a test can wait for an item instead of sleeping.
  *      3. Mult2: output = input * 2.1
  *      4. Div2Round: utput = floor(input/2)
  *      5. Mult3: output = input * 3.1
  *      6. Div2Round: output = floor(input/3)
  *      7. Add5: output = input + 5
  *      8. Div2: output = input / 2
+ *      9. Jitter: output = input, but the operation takes between 0 and 3 ms depending
+ *          on the input, so that parallel copies of an operator finish out of order.
+ *     10. AddressSource: Delivers 0, 1, 2, ... and completes with the last of a given number
+ *          of items. Records the address it has written each item to.
+ *     11. AddressProbe: output = input. Records the addresses it has read from and written to.
+ *     12. AddressSink: Records the address it has read each item from.
+ *          With the three address classes, we can test that an item is used where it is,
+ *          without being copied, when it is passed from one executer to the next.
+ *     13. Invert: output = 255 - input for every byte of a Frame. The buffer of the input
+ *          frame is moved to the output, so that it can be returned to a buffer pool.
+ *     14. ScoreShared: output = input * factor, for an item shared by a FanOutExecuter. The
+ *          sequence number is passed on, so that the results of two branches can be joined,
+ *          and the operation can be given a delay to make one branch slower than the other.
+ *     15. Busy: output = input, after spinning for a given time, which can be changed while
+ *          it runs, so that the cost of an operator is known and can drift.
+ *     16. CpuProbe: output = input. Records the CPU that each operation runs on.
+ *     17. Handle: an item that shares its value when copied, as a cv::Mat shares its pixels,
+ *          with a copyItem() that gives each branch of a FanOutExecuter a value of its own.
+ *     18. Counted: an item that counts how often it is constructed, so that a test can check
+ *          that items are recycled instead of created for every item.
  *****************************************************************************************/
 
 #include <operator.hpp>
 #include <opsexecuter.hpp>
+#include <ringbuffer.hpp>
+#include <spscbuffer.hpp>
+#include <conflatingbuffer.hpp>
+#include <fanoutjoin.hpp>
+#include <replicatedexecuter.hpp>
+#include <fusedchain.hpp>
+#include <pipeline.hpp>
+#include <bufferpool.hpp>
+#include <fileprefetcher.hpp>
+#include <partitioner.hpp>
+#include <batch.hpp>
+
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <cstdint>
+#include <atomic>
+#include <sched.h>
 
 using namespace parallelOperators;
 
@@ -36,7 +75,7 @@ private:
     int _endLimit;
 };
 
-OperationStatus CounterSource::operation()
+inline OperationStatus CounterSource::operation()
 {
     if (_counter < _endLimit)
     {
@@ -58,17 +97,19 @@ public:
     CounterSink(std::string opName): SinkOperator(opName) {};
     OperationStatus operation() override;
     float getValue();
+    std::atomic<size_t> received {0};
 private:
     float _sinkVariable {0};
 };
 
-OperationStatus CounterSink::operation()
+inline OperationStatus CounterSink::operation()
 {
     _sinkVariable = *_input;
+    received++;
     return OperationStatus::running;
 }
 
-float CounterSink::getValue()
+inline float CounterSink::getValue()
 {
     return _sinkVariable;
 }
@@ -83,7 +124,7 @@ public:
     OperationStatus operation() override;
 };
 
-OperationStatus Mult2::operation(){
+inline OperationStatus Mult2::operation(){
     *_output = 2.1*(*_input);
     return OperationStatus::running;
 };
@@ -97,7 +138,7 @@ public:
     OperationStatus operation() override;
 };
 
-OperationStatus Div2Round::operation(){
+inline OperationStatus Div2Round::operation(){
     *_output = std::floor((*_input)/2);
     return OperationStatus::running;
 };
@@ -113,7 +154,7 @@ public:
     OperationStatus operation() override;
 };
 
-OperationStatus Mult3::operation(){
+inline OperationStatus Mult3::operation(){
     *_output = 3.1*(*_input);
     return OperationStatus::running;
 };
@@ -129,7 +170,7 @@ public:
     OperationStatus operation() override;
 };
 
-OperationStatus Div3Round::operation(){
+inline OperationStatus Div3Round::operation(){
     *_output = std::floor((*_input)/3);
     return OperationStatus::running;
 };
@@ -145,7 +186,7 @@ public:
     OperationStatus operation() override;
 };
 
-OperationStatus Add5::operation(){
+inline OperationStatus Add5::operation(){
     *_output = 5.0 + *_input;
     return OperationStatus::running;
 };
@@ -161,7 +202,189 @@ public:
     OperationStatus operation() override;
 };
 
-OperationStatus Div2::operation(){
+inline OperationStatus Div2::operation(){
     *_output = *_input/2.0;
     return OperationStatus::running;
 };
+
+//----------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------
+class  Jitter : public Operator<float, float>
+{
+private:
+    
+public:
+    Jitter(std::string opName): Operator(opName) {};
+    OperationStatus operation() override;
+};
+
+inline OperationStatus Jitter::operation(){
+    std::this_thread::sleep_for(std::chrono::milliseconds(((int) *_input) % 4));
+    *_output = *_input;
+    return OperationStatus::running;
+};
+
+//----------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------
+class AddressSource : public SourceOperator<float>
+{
+public:
+    AddressSource(std::string opName, int items): SourceOperator(opName), _items(items) {};
+    OperationStatus operation() override;
+    std::vector<const float *> outputs;
+private:
+    int _counter {0};
+    int _items;
+};
+
+inline OperationStatus AddressSource::operation()
+{
+    *_output = _counter++;
+    outputs.push_back(_output);
+    return (_counter < _items) ? OperationStatus::running : OperationStatus::complete;
+}
+
+//----------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------
+class AddressProbe : public Operator<float, float>
+{
+public:
+    AddressProbe(std::string opName): Operator(opName) {};
+    OperationStatus operation() override;
+    std::vector<const float *> inputs;
+    std::vector<const float *> outputs;
+};
+
+inline OperationStatus AddressProbe::operation()
+{
+    *_output = *_input;
+    inputs.push_back(_input);
+    outputs.push_back(_output);
+    return OperationStatus::running;
+}
+
+//----------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------
+class AddressSink : public SinkOperator<float>
+{
+public:
+    AddressSink(std::string opName): SinkOperator(opName) {};
+    OperationStatus operation() override;
+    std::vector<const float *> inputs;
+    std::vector<float> values;
+    std::atomic<size_t> received {0};
+};
+
+inline OperationStatus AddressSink::operation()
+{
+    inputs.push_back(_input);
+    values.push_back(*_input);
+    received++;
+    return OperationStatus::running;
+}
+
+//----------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------
+struct Frame
+{
+    std::vector<uint8_t> data;
+};
+
+class Invert : public Operator<Frame, Frame>
+{
+public:
+    Invert(std::string opName): Operator(opName) {};
+    OperationStatus operation() override;
+};
+
+inline OperationStatus Invert::operation()
+{
+    for (uint8_t & byte : _input->data) byte = 255 - byte;
+    _output->data = std::move(_input->data);
+    return OperationStatus::running;
+}
+
+//----------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------
+struct Scored
+{
+    size_t sequence {0};
+    float value {0.0f};
+};
+
+class ScoreShared : public Operator<Shared<int>, Scored>
+{
+public:
+    ScoreShared(std::string opName, float factor, int delayMicroseconds = 0):
+        Operator(opName), _factor(factor), _delay(delayMicroseconds) {};
+    OperationStatus operation() override;
+
+private:
+    float _factor;
+    int _delay;
+};
+
+inline OperationStatus ScoreShared::operation()
+{
+    if (_delay > 0) std::this_thread::sleep_for(std::chrono::microseconds(_delay));
+    _output->sequence = _input->sequence;
+    _output->value = _factor * (*_input->data);
+    return OperationStatus::running;
+}
+
+//----------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------
+class Busy : public Operator<float, float>
+{
+public:
+    Busy(std::string opName, int microseconds): Operator(opName), _microseconds(microseconds) {};
+    OperationStatus operation() override;
+    void microseconds(int value) { _microseconds.store(value); };
+
+private:
+    std::atomic<int> _microseconds;
+};
+
+inline OperationStatus Busy::operation()
+{
+    auto end = std::chrono::steady_clock::now() + std::chrono::microseconds(_microseconds.load());
+    while (std::chrono::steady_clock::now() < end) {}
+    *_output = *_input;
+    return OperationStatus::running;
+}
+
+//----------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------
+class CpuProbe : public Operator<float, float>
+{
+public:
+    CpuProbe(std::string opName): Operator(opName) {};
+    OperationStatus operation() override;
+    std::vector<int> cpus;
+};
+
+inline OperationStatus CpuProbe::operation()
+{
+    cpus.push_back(sched_getcpu());
+    *_output = *_input;
+    return OperationStatus::running;
+}
+
+//----------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------
+struct Handle
+{
+    std::shared_ptr<int> value;
+};
+
+inline void copyItem(Handle & destination, const Handle & source)
+{
+    destination.value = std::make_shared<int>(*source.value);
+}
+
+struct Counted
+{
+    Counted() { constructed++; };
+    int value {0};
+    static inline std::atomic<int> constructed {0};
+};
@@ -1,10 +1,35 @@
 #include <gtest/gtest.h>
 #include <iostream>
+#include <sstream>
 #include <cmath>
+#include <fstream>
+#include <filesystem>
+#include <cstdlib>
+#include <new>
 
 /******************************************************************************************
  */
 #include "classdefs.hpp"
+
+// Every allocation in the test program is counted, so that a test can check that a
+// pipeline runs without allocating once it has reached steady state. The operators are not
+// inlined, so that the compiler does not pair the free() with a new expression.
+static std::atomic<size_t> allocations {0};
+
+__attribute__((noinline)) void * operator new(std::size_t size)
+{
+    allocations++;
+    if (void * p = std::malloc(size)) return p;
+    throw std::bad_alloc();
+}
+__attribute__((noinline)) void operator delete(void * p) noexcept
+{
+    std::free(p);
+}
+__attribute__((noinline)) void operator delete(void * p, std::size_t) noexcept
+{
+    std::free(p);
+}
  /*
  * In this file, 8 simple classes are defined to be used for testing of the system
  *      1. CounterSource: Start at a given number. Add 1 at each call 5 times.
@@ -20,6 +45,8 @@
  *      6. Div2Round: output = floor(input/3)
  *      7. Add5: output = input + 5
  *      8. Div2: output = input / 2
+ *      9. Jitter: output = input, but the operation takes between 0 and 3 ms depending
+ *          on the input, so that parallel copies of an operator finish out of order.
  *****************************************************************************************/
 
 class OperatorTest : public ::testing::Test
@@ -169,6 +196,12 @@ protected:
     // }
 };
 
+// Waits until the sink has received the given number of items, instead of a fixed time.
+void waitForItems(const CounterSink & sink, size_t items)
+{
+    while (sink.received.load() < items) std::this_thread::yield();
+}
+
 TEST_F(ExecutionTest, OneThreadTest)
 {   
     std::cout << "[ INFO     ] " << "Test of linked operators run in a thread.\n";
@@ -234,8 +267,6 @@ TEST_F(ExecutionTest, TwoThreadsTest)
     exec1.startThread();
     exec2.startThread();
 
-    std::this_thread::sleep_for (std::chrono::milliseconds(100));
-
     auto input = make_unique<int>();
     auto output = make_unique<float>();
 
@@ -249,7 +280,6 @@ TEST_F(ExecutionTest, TwoThreadsTest)
     exec2.output()->receive(output);
     ASSERT_NEAR(*output, (std::floor(15*3.1/3)+5.0)/2.0, 1e-5);
 
-    std::this_thread::sleep_for (std::chrono::milliseconds(100));
     exec1.stop();
     exec2.stop();
 
@@ -295,35 +325,28 @@ TEST_F(ExecutionTest, FourThreadsCompleteTest)
     exec2.startThread();
     sink.startThread();
 
-    auto input = make_unique<int>();
-    auto output = make_unique<float>();
-
-    std::this_thread::sleep_for (std::chrono::milliseconds(100));
-
+    // The first item, 37, is produced with the step command that was sent before the start.
     int inputValue = 37;
+    waitForItems(cSnk, 1);
     source.send(ExecutionMode::Step);
-    std::this_thread::sleep_for (std::chrono::milliseconds(100));
+    waitForItems(cSnk, inputValue - 35);
     ASSERT_NEAR(cSnk.getValue(), (std::floor((++inputValue)*3.1/3)+5.0)/2.0, 1e-5);
 
     source.send(ExecutionMode::Step);
-    std::this_thread::sleep_for (std::chrono::milliseconds(100));
+    waitForItems(cSnk, inputValue - 35);
     ASSERT_NEAR(cSnk.getValue(), (std::floor((++inputValue)*3.1/3)+5.0)/2.0, 1e-5);
 
     source.send(ExecutionMode::Step);
-    std::this_thread::sleep_for (std::chrono::milliseconds(100));
+    waitForItems(cSnk, inputValue - 35);
     ASSERT_NEAR(cSnk.getValue(), (std::floor((++inputValue)*3.1/3)+5.0)/2.0, 1e-5);
 
-    std::this_thread::sleep_for (std::chrono::milliseconds(100));
-
-    source.stop();
-    exec1.stop();
-    exec2.stop();
-    sink.stop();
-
+    // The stream is ended at the source and drains through the other Executers.
+    source.finish();
+    source.waitToEnd();
     exec1.waitToEnd();
     exec2.waitToEnd();
-    source.waitToEnd();
     sink.waitToEnd();
+    ASSERT_EQ(cSnk.received.load(), 4u);
 
 }
 
@@ -364,41 +387,33 @@ TEST_F(ExecutionTest, FourThreadsCompleteTestRun5times)
     exec2.startThread();
     sink.startThread();
 
-    auto input = make_unique<int>();
-    auto output = make_unique<float>();
-
-    std::this_thread::sleep_for (std::chrono::milliseconds(100));
-
+    // The first item, 37, is produced with the step command that was sent before the start.
     int inputValue = 37;
+    waitForItems(cSnk, 1);
     source.send(ExecutionMode::Step);
-    std::this_thread::sleep_for (std::chrono::milliseconds(100));
+    waitForItems(cSnk, inputValue - 35);
     ASSERT_NEAR(cSnk.getValue(), (std::floor((++inputValue)*3.1/3)+5.0)/2.0, 1e-5);
 
     source.send(ExecutionMode::Step);
-    std::this_thread::sleep_for (std::chrono::milliseconds(100));
+    waitForItems(cSnk, inputValue - 35);
     ASSERT_NEAR(cSnk.getValue(), (std::floor((++inputValue)*3.1/3)+5.0)/2.0, 1e-5);
 
     source.send(ExecutionMode::Step);
-    std::this_thread::sleep_for (std::chrono::milliseconds(100));
+    waitForItems(cSnk, inputValue - 35);
     ASSERT_NEAR(cSnk.getValue(), (std::floor((++inputValue)*3.1/3)+5.0)/2.0, 1e-5);
 
     source.send(ExecutionMode::Step);
-    std::this_thread::sleep_for (std::chrono::milliseconds(100));
+    waitForItems(cSnk, inputValue - 35);
     ASSERT_NEAR(cSnk.getValue(), (std::floor((++inputValue)*3.1/3)+5.0)/2.0, 1e-5);
 
     source.send(ExecutionMode::Step);
-    std::this_thread::sleep_for (std::chrono::milliseconds(100));
+    waitForItems(cSnk, inputValue - 35);
     ASSERT_NEAR(cSnk.getValue(), (std::floor((++inputValue)*3.1/3)+5.0)/2.0, 1e-5);
 
     std::cout << "[ INFO     ] " << "All results obtained.\n";
 
-    std::this_thread::sleep_for (std::chrono::milliseconds(100));
- 
-
-    sink.stop();
-    exec2.stop();
-    exec1.stop();
-    source.stop();
+    // The source is complete with the last item, and the stream drains by itself.
+    source.finish();
     std::cout << "[ INFO     ] " << "Wait for Source to end .\n";
     source.waitToEnd();
     std::cout << "[ INFO     ] " << "Source ended.\n"; 
@@ -414,5 +429,1175 @@ TEST_F(ExecutionTest, FourThreadsCompleteTestRun5times)
     std::cout << "[ INFO     ] " << "Wait for Sink to end.\n";
     sink.waitToEnd();
     std::cout << "[ INFO     ] " << "Sink ended.\n";
+    ASSERT_EQ(cSnk.received.load(), 6u);
+
+}
+
+TEST(BufferTest, RingBufferKeepsOrder)
+{
+    std::cout << "[ INFO     ] " << "Test of a ring buffer that takes several items before the first is received.\n";
+
+    RingBuffer<int, 4> ring("ring_4");
+    auto input = make_unique<int>();
+    auto output = make_unique<int>();
+
+    // All four slots can be filled without a receiver.
+    for (int i = 0; i < 4; i++)
+    {
+        *input = 10 + i;
+        ring.send(input);
+    }
+    for (int i = 0; i < 4; i++)
+    {
+        ring.receive(output);
+        ASSERT_EQ(*output, 10 + i);
+    }
+}
+
+TEST_F(ExecutionTest, TwoThreadsRingBufferTest)
+{
+    std::cout << "[ INFO     ] " << "Test of linked operators run in two threads connected with a ring buffer.\n";
+
+    op2.input(op1.output());
+    exec1.opInput(op1.inputAddress());
+    exec1.opOutput(op2.outputAddress());
+    exec1.addOperator(&op1);
+    exec1.addOperator(&op2);
+
+    op4.input(op3.output());
+    exec2.opInput(op3.inputAddress());
+    exec2.opOutput(op4.outputAddress());
+    exec2.addOperator(&op3);
+    exec2.addOperator(&op4);
+
+    exec2.input(make_shared<RingBuffer<float, 4>>("ring_between_1_and_2"));
+    exec1.output(exec2.input());
+    exec1.input(make_shared<RingBuffer<int, 4>>("ring_at_input"));
+
+    exec1.send(ExecutionMode::Continuous);
+    exec2.send(ExecutionMode::Continuous);
+    exec1.startThread();
+    exec2.startThread();
+
+    auto input = make_unique<int>();
+    auto output = make_unique<float>();
+
+    // Several inputs are sent before the first result is collected.
+    for (int i = 10; i < 14; i++)
+    {
+        *input = i;
+        exec1.input()->send(input);
+    }
+    for (int i = 10; i < 14; i++)
+    {
+        exec2.output()->receive(output);
+        ASSERT_NEAR(*output, (std::floor(i*3.1/3)+5.0)/2.0, 1e-5);
+    }
+
+    exec1.stop();
+    exec2.stop();
+
+    exec1.waitToEnd();
+    exec2.waitToEnd();
+}
+
+TEST(BufferTest, SpscBufferBetweenTwoThreads)
+{
+    std::cout << "[ INFO     ] " << "Test of the lock-free buffer with one producer and one consumer thread.\n";
+
+    SpscBuffer<int, 2> spsc("spsc_2");
+    const int items = 10000;
+
+    thread producer([&spsc]()
+    {
+        auto input = make_unique<int>();
+        for (int i = 0; i < items; i++)
+        {
+            *input = i;
+            spsc.send(input);
+        }
+    });
+
+    auto output = make_unique<int>();
+    for (int i = 0; i < items; i++)
+    {
+        spsc.receive(output);
+        ASSERT_EQ(*output, i);
+    }
+    producer.join();
+}
+
+TEST_F(ExecutionTest, TwoThreadsSpscBufferTest)
+{
+    std::cout << "[ INFO     ] " << "Test of linked operators run in two threads connected with lock-free buffers.\n";
+
+    op2.input(op1.output());
+    exec1.opInput(op1.inputAddress());
+    exec1.opOutput(op2.outputAddress());
+    exec1.addOperator(&op1);
+    exec1.addOperator(&op2);
+
+    op4.input(op3.output());
+    exec2.opInput(op3.inputAddress());
+    exec2.opOutput(op4.outputAddress());
+    exec2.addOperator(&op3);
+    exec2.addOperator(&op4);
+
+    exec1.input(make_shared<SpscBuffer<int>>("spsc_at_input"));
+    exec2.input(make_shared<SpscBuffer<float>>("spsc_between_1_and_2"));
+    exec1.output(exec2.input());
+    exec2.output(make_shared<SpscBuffer<float>>("spsc_at_output"));
+
+    exec1.send(ExecutionMode::Continuous);
+    exec2.send(ExecutionMode::Continuous);
+    exec1.startThread();
+    exec2.startThread();
+
+    auto input = make_unique<int>();
+    auto output = make_unique<float>();
+
+    for (int i = 10; i < 20; i++)
+    {
+        *input = i;
+        exec1.input()->send(input);
+        exec2.output()->receive(output);
+        ASSERT_NEAR(*output, (std::floor(i*3.1/3)+5.0)/2.0, 1e-5);
+    }
+
+    exec1.stop();
+    exec2.stop();
+
+    exec1.waitToEnd();
+    exec2.waitToEnd();
+}
+
+TEST(BufferTest, WaitPoliciesDeliverInOrder)
+{
+    std::cout << "[ INFO     ] " << "Test of the buffers with all three wait policies.\n";
+
+    for (WaitPolicy policy : {WaitPolicy::Block, WaitPolicy::SpinYield, WaitPolicy::Spin})
+    {
+        UniqueBuffer<int> unique("unique");
+        SpscBuffer<int> spsc("spsc");
+        unique.waitPolicy(policy);
+        spsc.waitPolicy(policy);
+        const int items = 20;
+
+        thread producer([&unique, &spsc]()
+        {
+            auto input = make_unique<int>();
+            for (int i = 0; i < items; i++)
+            {
+                *input = i;
+                unique.send(input);
+                *input = i;
+                spsc.send(input);
+            }
+        });
+
+        auto output = make_unique<int>();
+        for (int i = 0; i < items; i++)
+        {
+            unique.receive(output);
+            ASSERT_EQ(*output, i);
+            spsc.receive(output);
+            ASSERT_EQ(*output, i);
+        }
+        producer.join();
+    }
+}
+
+TEST_F(ExecutionTest, OneThreadSpinYieldTest)
+{
+    std::cout << "[ INFO     ] " << "Test of linked operators in a thread that spins before it blocks.\n";
+
+    op2.input(op1.output());
+    exec1.opInput(op1.inputAddress());
+    exec1.opOutput(op2.outputAddress());
+    exec1.addOperator(&op1);
+    exec1.addOperator(&op2);
+    exec1.waitPolicy(WaitPolicy::SpinYield);
+
+    auto input = make_unique<int>();
+    auto output = make_unique<float>();
+
+    exec1.startThread();
+
+    // Step mode, where the thread waits for the command with the selected policy.
+    for (int i = 10; i < 15; i++)
+    {
+        exec1.send(ExecutionMode::Step);
+        *input = i;
+        exec1.input()->send(input);
+        exec1.output()->receive(output);
+        ASSERT_NEAR(*output, std::floor(i*3.1/3), 1e-5);
+    }
+
+    exec1.stop();
+    exec1.waitToEnd();
+}
+
+class ReplicationTest : public ::testing::TestWithParam<DispatchPolicy>
+{
+protected:
+    static const size_t replicas = 3;
+    Mult3 mult[replicas] = {Mult3("multiply_3.1_0"), Mult3("multiply_3.1_1"), Mult3("multiply_3.1_2")};
+    Jitter jitter[replicas] = {Jitter("jitter_0"), Jitter("jitter_1"), Jitter("jitter_2")};
+};
+
+TEST_P(ReplicationTest, ResultsInInputOrder)
+{
+    std::cout << "[ INFO     ] " << "Test of an operator chain replicated in three threads.\n";
+
+    ReplicatedExecuter<int,float> exec = ReplicatedExecuter<int,float>("Replicated", replicas, GetParam());
+    for (size_t i = 0; i < replicas; i++)
+    {
+        jitter[i].input(mult[i].output());
+        exec.replica(i).opInput(mult[i].inputAddress());
+        exec.replica(i).opOutput(jitter[i].outputAddress());
+        exec.replica(i).addOperator(&mult[i]);
+        exec.replica(i).addOperator(&jitter[i]);
+    }
+
+    exec.send(ExecutionMode::Continuous);
+    exec.startThread();
+
+    const int items = 30;
+    thread producer([&exec]()
+    {
+        auto input = make_unique<int>();
+        for (int i = 0; i < items; i++)
+        {
+            *input = i;
+            exec.input()->send(input);
+        }
+    });
+
+    auto output = make_unique<float>();
+    for (int i = 0; i < items; i++)
+    {
+        exec.output()->receive(output);
+        ASSERT_NEAR(*output, i*3.1, 1e-4);
+    }
+    producer.join();
+
+    exec.stop();
+    exec.waitToEnd();
+}
+
+TEST_P(ReplicationTest, DrainsAfterEndOfStream)
+{
+    std::cout << "[ INFO     ] " << "Test that a replicated chain delivers all items before the end of the stream.\n";
+
+    ReplicatedExecuter<int,float> exec = ReplicatedExecuter<int,float>("Replicated", replicas, GetParam());
+    for (size_t i = 0; i < replicas; i++)
+    {
+        jitter[i].input(mult[i].output());
+        exec.replica(i).opInput(mult[i].inputAddress());
+        exec.replica(i).opOutput(jitter[i].outputAddress());
+        exec.replica(i).addOperator(&mult[i]);
+        exec.replica(i).addOperator(&jitter[i]);
+    }
+
+    exec.send(ExecutionMode::Continuous);
+    exec.startThread();
+
+    const int items = 30;
+    thread producer([&exec]()
+    {
+        auto input = make_unique<int>();
+        for (int i = 0; i < items; i++)
+        {
+            *input = i;
+            exec.input()->send(input);
+        }
+        exec.input()->close();
+    });
+
+    auto output = make_unique<float>();
+    int received = 0;
+    while (exec.output()->receive(output))
+    {
+        ASSERT_NEAR(*output, (received++)*3.1, 1e-4);
+    }
+    ASSERT_EQ(received, items);
+    producer.join();
+    exec.waitToEnd();
+}
+
+INSTANTIATE_TEST_SUITE_P(DispatchPolicies, ReplicationTest, ::testing::Values(DispatchPolicy::RoundRobin, DispatchPolicy::LeastBusy));
+
+TEST_F(ExecutionTest, TwoExecutersInPoolTest)
+{
+    std::cout << "[ INFO     ] " << "Test of linked operators run as tasks in a work-stealing pool.\n";
+
+    op2.input(op1.output());
+    exec1.opInput(op1.inputAddress());
+    exec1.opOutput(op2.outputAddress());
+    exec1.addOperator(&op1);
+    exec1.addOperator(&op2);
+
+    op4.input(op3.output());
+    exec2.opInput(op3.inputAddress());
+    exec2.opOutput(op4.outputAddress());
+    exec2.addOperator(&op3);
+    exec2.addOperator(&op4);
+
+    exec2.input(exec1.output());
+
+    WorkStealingPool pool(2);
+    exec1.send(ExecutionMode::Continuous);
+    exec2.send(ExecutionMode::Continuous);
+    exec1.startTask(pool);
+    exec2.startTask(pool);
+
+    auto input = make_unique<int>();
+    auto output = make_unique<float>();
+
+    for (int i = 10; i < 20; i++)
+    {
+        *input = i;
+        exec1.input()->send(input);
+        exec2.output()->receive(output);
+        ASSERT_NEAR(*output, (std::floor(i*3.1/3)+5.0)/2.0, 1e-5);
+    }
+
+    // In step mode, the task is only scheduled when a command has arrived.
+    exec1.send(ExecutionMode::Step);
+    *input = 16;
+    exec1.input()->send(input);
+    exec2.output()->receive(output);
+    ASSERT_NEAR(*output, (std::floor(16*3.1/3)+5.0)/2.0, 1e-5);
+
+    exec1.stop();
+    exec2.stop();
+
+    exec1.waitToEnd();
+    exec2.waitToEnd();
+}
+
+TEST_F(ExecutionTest, FourExecutersCompleteInPoolTest)
+{
+    std::cout << "[ INFO     ] " << "Test of a complete chain with source and sink run as tasks on one worker.\n";
+
+    op2.input(op1.output());
+    exec1.opInput(op1.inputAddress());
+    exec1.opOutput(op2.outputAddress());
+    exec1.addOperator(&op1);
+    exec1.addOperator(&op2);
+
+    op4.input(op3.output());
+    exec2.opInput(op3.inputAddress());
+    exec2.opOutput(op4.outputAddress());
+    exec2.addOperator(&op3);
+    exec2.addOperator(&op4);
+
+    source.addOperator(&cSrc);
+    source.opOutput(cSrc.outputAddress());
+
+    sink.addOperator(&cSnk);
+    sink.opInput(cSnk.inputAddress());
+
+    exec1.input(source.output());
+    exec2.input(exec1.output());
+    sink.input(exec2.output());
+
+    // Four executers share one worker, which is only possible since none of them blocks it.
+    WorkStealingPool pool(1);
+    source.send(ExecutionMode::Continuous);
+    exec1.send(ExecutionMode::Continuous);
+    exec2.send(ExecutionMode::Continuous);
+    sink.send(ExecutionMode::Continuous);
+
+    sink.startTask(pool);
+    exec2.startTask(pool);
+    exec1.startTask(pool);
+    source.startTask(pool);
+
+    // The source completes by itself after the last value, 37 + 5, and the end of the
+    // stream passes all executers behind it.
+    source.waitToEnd();
+    exec1.waitToEnd();
+    exec2.waitToEnd();
+    sink.waitToEnd();
+    ASSERT_NEAR(cSnk.getValue(), (std::floor(42*3.1/3)+5.0)/2.0, 1e-5);
+}
+
+TEST(PoolTest, ParallelForRunsEveryIndexOnce)
+{
+    std::cout << "[ INFO     ] " << "Test of splitting work over the pool, also from inside a worker.\n";
+
+    WorkStealingPool pool(3);
+    std::vector<std::atomic<int>> counts(100);
+    pool.parallelFor(counts.size(), [&counts](size_t i) { counts[i]++; });
+    for (auto & c : counts) ASSERT_EQ(c.load(), 1);
+
+    // A job that splits its own work again, which must not wait for a worker that is
+    // itself waiting.
+    std::vector<std::atomic<int>> nested(4 * 25);
+    pool.parallelFor(4, [&pool, &nested](size_t outer)
+    {
+        pool.parallelFor(25, [&nested, outer](size_t inner) { nested[outer * 25 + inner]++; });
+    });
+    for (auto & c : nested) ASSERT_EQ(c.load(), 1);
+
+    pool.parallelFor(0, [](size_t) { FAIL(); });
+}
+
+TEST(BufferPoolTest, SteadyStateIsAllocationFree)
+{
+    std::cout << "[ INFO     ] " << "Test that frames from a pool pass an executer without any allocation.\n";
+
+    const size_t frameSize = 4096;
+    BufferPool<std::vector<uint8_t>, size_t> pool([](const size_t & size) { return std::vector<uint8_t>(size); });
+    Invert invert("invert");
+    OperatorExecuter<Frame, Frame> exec("Exec_pool");
+    exec.addOperator(&invert);
+    exec.opInput(invert.inputAddress());
+    exec.opOutput(invert.outputAddress());
+    exec.send(ExecutionMode::Continuous);
+    exec.startThread();
+
+    auto input = make_unique<Frame>();
+    auto output = make_unique<Frame>();
+    auto process = [&](int items)
+    {
+        for (int i = 0; i < items; i++)
+        {
+            input->data = pool.acquire(frameSize);
+            input->data[0] = (uint8_t) i;
+            exec.input()->send(input);
+            exec.output()->receive(output);
+            ASSERT_EQ(output->data[0], (uint8_t) (255 - (uint8_t) i));
+            pool.release(frameSize, std::move(output->data));
+        }
+    };
+
+    // The first items fill the pool and the queues of the executer.
+    process(10);
+    size_t before = allocations.load();
+    process(1000);
+    size_t after = allocations.load();
+    exec.stop();
+    exec.waitToEnd();
+    ASSERT_EQ(after - before, 0u);
+    ASSERT_LE(pool.created(), 3u);
+    ASSERT_EQ(pool.acquire(frameSize).size(), frameSize);
+}
+
+TEST(PrefetchTest, FilesArriveInOrderWithinBudget)
+{
+    std::cout << "[ INFO     ] " << "Test that the prefetcher delivers the files in order and holds no more than its budget.\n";
+
+    std::filesystem::path dir = std::filesystem::temp_directory_path() / "prefetch_test";
+    std::filesystem::create_directories(dir);
+    std::vector<std::filesystem::path> files;
+    for (int i = 0; i < 10; i++)
+    {
+        files.emplace_back(dir / ("file_" + std::to_string(i)));
+        std::ofstream(files.back(), std::ios::binary) << std::string(1000 + i, (char) ('a' + i));
+    }
+    files.emplace_back(dir / "missing");
+
+    FilePrefetcher prefetcher(files, 4, 2500);
+    std::vector<uint8_t> bytes;
+    for (int i = 0; i < 10; i++)
+    {
+        ASSERT_TRUE(prefetcher.next(bytes));
+        ASSERT_EQ(bytes.size(), 1000u + i);
+        ASSERT_EQ(bytes.front(), (uint8_t) ('a' + i));
+        ASSERT_EQ(bytes.back(), (uint8_t) ('a' + i));
+        // Give the prefetcher time to fill up to its limits.
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    ASSERT_TRUE(prefetcher.next(bytes));
+    ASSERT_TRUE(bytes.empty());
+    ASSERT_FALSE(prefetcher.next(bytes));
+    ASSERT_LE(prefetcher.peakBytes(), 2500u);
+    ASSERT_GE(prefetcher.peakBytes(), 2000u);
+    std::filesystem::remove_all(dir);
+}
+
+TEST(BranchTest, BroadcastAndJoinInOrder)
+{
+    std::cout << "[ INFO     ] " << "Test of two branches that get a copy of each item, joined in order.\n";
+
+    FanOutExecuter<int> fanOut("FanOut", 2);
+    Mult2 mult2("mult_2");
+    Mult3 mult3("mult_3");
+    OperatorExecuter<int, float> branch0("Branch_0");
+    OperatorExecuter<int, float> branch1("Branch_1");
+    JoinExecuter<float, float> join("Join");
+    branch0.addOperator(&mult2);
+    branch0.opInput(mult2.inputAddress());
+    branch0.opOutput(mult2.outputAddress());
+    branch1.addOperator(&mult3);
+    branch1.opInput(mult3.inputAddress());
+    branch1.opOutput(mult3.outputAddress());
+    branch0.input(fanOut.output(0));
+    branch1.input(fanOut.output(1));
+    join.input<0>(branch0.output());
+    join.input<1>(branch1.output());
+
+    Pipeline pipeline("Branches");
+    pipeline.add(fanOut).add(branch0).add(branch1).add(join);
+    pipeline.start();
+    auto input = make_unique<int>();
+    auto result = make_unique<std::tuple<float, float>>();
+    for (int i = 0; i < 100; i++)
+    {
+        *input = i;
+        fanOut.input()->send(input);
+        ASSERT_TRUE(join.output()->receive(result));
+        ASSERT_NEAR(std::get<0>(*result), 2.1 * i, 1e-3);
+        ASSERT_NEAR(std::get<1>(*result), 3.1 * i, 1e-3);
+    }
+    fanOut.input()->close();
+    ASSERT_FALSE(join.output()->receive(result));
+    pipeline.drain();
+    ASSERT_EQ(join.dropped(), 0u);
+}
+
+TEST(BranchTest, SharedItemsJoinedBySequence)
+{
+    std::cout << "[ INFO     ] " << "Test of a join that matches the sequence numbers when a slow branch skips items.\n";
+
+    // The slow branch is fed through a conflating buffer and only sees some of the items.
+    FanOutExecuter<int, Shared<int>> fanOut("FanOut", 2);
+    fanOut.output(1, make_shared<ConflatingBuffer<Shared<int>>>("conflating"));
+    ScoreShared fast("fast", 2.0f);
+    ScoreShared slow("slow", 3.0f, 1000);
+    OperatorExecuter<Shared<int>, Scored> branch0("Branch_fast");
+    OperatorExecuter<Shared<int>, Scored> branch1("Branch_slow");
+    JoinExecuter<Scored, Scored> join("Join");
+    branch0.addOperator(&fast);
+    branch0.opInput(fast.inputAddress());
+    branch0.opOutput(fast.outputAddress());
+    branch1.addOperator(&slow);
+    branch1.opInput(slow.inputAddress());
+    branch1.opOutput(slow.outputAddress());
+    branch0.input(fanOut.output(0));
+    branch1.input(fanOut.output(1));
+    join.input<0>(branch0.output());
+    join.input<1>(branch1.output());
+
+    Pipeline pipeline("SharedBranches");
+    pipeline.add(fanOut).add(branch0).add(branch1).add(join);
+    pipeline.start();
+    const int items = 100;
+    std::thread producer([&fanOut]()
+    {
+        auto input = make_unique<int>();
+        for (int i = 0; i < items; i++)
+        {
+            *input = i;
+            fanOut.input()->send(input);
+        }
+        fanOut.input()->close();
+    });
+    auto result = make_unique<std::tuple<Scored, Scored>>();
+    std::vector<size_t> joined;
+    while (join.output()->receive(result))
+    {
+        Scored & a = std::get<0>(*result);
+        Scored & b = std::get<1>(*result);
+        ASSERT_EQ(a.sequence, b.sequence);
+        ASSERT_FLOAT_EQ(a.value, 2.0f * a.sequence);
+        ASSERT_FLOAT_EQ(b.value, 3.0f * b.sequence);
+        if (!joined.empty())
+        {
+            ASSERT_GT(a.sequence, joined.back());
+        }
+        joined.push_back(a.sequence);
+    }
+    producer.join();
+    pipeline.drain();
+    ASSERT_EQ(joined.back(), (size_t) items - 1);
+    ASSERT_EQ(joined.size() + join.dropped(), (size_t) items);
+    ASSERT_GT(join.dropped(), 0u);
+}
+
+TEST(BranchTest, BroadcastCopiesWithCopyItem)
+{
+    std::cout << "[ INFO     ] " << "Test that a broadcast copies the items with the copyItem() of their type.\n";
+
+    FanOutExecuter<Handle> fanOut("FanOut", 2);
+    Pipeline pipeline("Broadcast");
+    pipeline.add(fanOut);
+    pipeline.start();
+    auto input = make_unique<Handle>();
+    auto result0 = make_unique<Handle>();
+    auto result1 = make_unique<Handle>();
+    for (int i = 0; i < 10; i++)
+    {
+        input->value = std::make_shared<int>(i);
+        fanOut.input()->send(input);
+        ASSERT_TRUE(fanOut.output(0)->receive(result0));
+        ASSERT_TRUE(fanOut.output(1)->receive(result1));
+        ASSERT_EQ(*result0->value, i);
+        ASSERT_EQ(*result1->value, i);
+        ASSERT_NE(result0->value, result1->value);
+    }
+    fanOut.input()->close();
+    pipeline.drain();
+}
+
+TEST(BranchTest, SharedItemsAreRecycled)
+{
+    std::cout << "[ INFO     ] " << "Test that the shared items are handed back to the input when the branches let go of them.\n";
+
+    FanOutExecuter<Counted, Shared<Counted>> fanOut("FanOut", 1);
+    Pipeline pipeline("SharedRecycling");
+    pipeline.add(fanOut);
+    pipeline.start();
+    auto input = make_unique<Counted>();
+    auto result = make_unique<Shared<Counted>>();
+    int before = Counted::constructed.load();
+    for (int i = 0; i < 100; i++)
+    {
+        input->value = i;
+        fanOut.input()->send(input);
+        ASSERT_TRUE(fanOut.output(0)->receive(result));
+        ASSERT_EQ(result->data->value, i);
+        result->data.reset();
+    }
+    fanOut.input()->close();
+    pipeline.drain();
+    // Only the items in flight at the same time are created.
+    ASSERT_LE(Counted::constructed.load() - before, 5);
+}
+
+TEST_F(ExecutionTest, FusedChainTest)
+{
+    std::cout << "[ INFO     ] " << "Test of four operators fused into one, run in a thread.\n";
+
+    FusedChain<Mult3, Div3Round, Add5, Div2> chain("fused", op1, op2, op3, op4);
+    exec1.opInput(chain.inputAddress());
+    exec1.opOutput(chain.outputAddress());
+    exec1.addOperator(&chain);
+
+    auto input = make_unique<int>();
+    auto output = make_unique<float>();
+
+    exec1.send(ExecutionMode::Continuous);
+    exec1.startThread();
+
+    for (int i = 10; i < 20; i++)
+    {
+        *input = i;
+        exec1.input()->send(input);
+        exec1.output()->receive(output);
+        ASSERT_NEAR(*output, (std::floor(i*3.1/3)+5.0)/2.0, 1e-5);
+    }
+
+    exec1.stop();
+    exec1.waitToEnd();
+}
+
+TEST(ZeroCopyTest, ItemsAreUsedWhereTheyAre)
+{
+    std::cout << "[ INFO     ] " << "Test that the operators of neighbouring threads work on the same data, without copies.\n";
+
+    const int items = 20;
+    AddressSource aSrc("address_source", items);
+    AddressProbe probe1("address_probe_1");
+    AddressProbe probe2("address_probe_2");
+    AddressSink aSnk("address_sink");
+
+    SourceExecuter<float> source("Source");
+    OperatorExecuter<float,float> exec1("Exec_1");
+    OperatorExecuter<float,float> exec2("Exec_2");
+    SinkExecuter<float> sink("Sink");
+
+    source.addOperator(&aSrc);
+    source.opOutput(aSrc.outputAddress());
+    exec1.addOperator(&probe1);
+    exec1.opInput(probe1.inputAddress());
+    exec1.opOutput(probe1.outputAddress());
+    exec2.addOperator(&probe2);
+    exec2.opInput(probe2.inputAddress());
+    exec2.opOutput(probe2.outputAddress());
+    sink.addOperator(&aSnk);
+    sink.opInput(aSnk.inputAddress());
+
+    exec1.input(source.output());
+    exec2.input(exec1.output());
+    sink.input(exec2.output());
+
+    Pipeline pipeline("ZeroCopy");
+    pipeline.add(source).add(exec1).add(exec2).add(sink);
+    pipeline.start();
+    pipeline.drain();
+
+    ASSERT_EQ(aSnk.received.load(), items);
+    for (int i = 0; i < items; i++)
+    {
+        ASSERT_EQ(aSnk.values[i], i);
+        ASSERT_EQ(aSrc.outputs[i], probe1.inputs[i]);
+        ASSERT_EQ(probe1.outputs[i], probe2.inputs[i]);
+        ASSERT_EQ(probe2.outputs[i], aSnk.inputs[i]);
+    }
+}
+
+TEST(BufferTest, ConflatingBufferKeepsNewest)
+{
+    std::cout << "[ INFO     ] " << "Test that a conflating buffer never blocks the sender and delivers the newest item.\n";
+
+    ConflatingBuffer<int> buffer("conflating");
+    auto data = make_unique<int>(1);
+    int * first = data.get();
+    buffer.send(data);
+    *data = 2;
+    buffer.send(data);
+    // The unread first item came back to the producer.
+    ASSERT_EQ(data.get(), first);
+    *data = 3;
+    buffer.send(data);
+    ASSERT_EQ(buffer.dropped(), 2u);
+    ASSERT_TRUE(buffer.receive(data));
+    ASSERT_EQ(*data, 3);
+    ASSERT_FALSE(buffer.tryReceive(data));
+
+    // A slow consumer gets newer and newer items, and the last one before the end.
+    const int items = 200;
+    std::vector<int> received;
+    std::thread producer([&buffer]()
+    {
+        auto item = make_unique<int>();
+        for (int i = 0; i < items; i++)
+        {
+            *item = i;
+            buffer.send(item);
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+        buffer.close();
+    });
+    while (buffer.receive(data))
+    {
+        received.push_back(*data);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    producer.join();
+    ASSERT_EQ(received.back(), items - 1);
+    for (size_t i = 1; i < received.size(); i++) ASSERT_GT(received[i], received[i - 1]);
+    ASSERT_EQ(received.size() + buffer.dropped(), items + 2u);
+    ASSERT_GT(buffer.dropped(), 2u);
+    ASSERT_TRUE(buffer.endOfStream());
+}
+
+TEST(BufferTest, ClosedBuffersDeliverRemainingItems)
+{
+    std::cout << "[ INFO     ] " << "Test that the end of a stream is received after the remaining items.\n";
+
+    RingBuffer<int, 4> ring("ring");
+    SpscBuffer<int, 4> spsc("spsc");
+    UniqueBuffer<int> unique("unique");
+    std::vector<BaseBuffer<int> *> buffers {&ring, &spsc, &unique};
+    for (BaseBuffer<int> * buffer : buffers)
+    {
+        auto data = make_unique<int>();
+        const int items = (buffer == &unique) ? 1 : 3;
+        for (int i = 0; i < items; i++)
+        {
+            *data = i;
+            buffer->send(data);
+        }
+        buffer->close();
+        ASSERT_FALSE(buffer->endOfStream());
+        for (int i = 0; i < items; i++)
+        {
+            ASSERT_TRUE(buffer->receive(data));
+            ASSERT_EQ(*data, i);
+        }
+        ASSERT_TRUE(buffer->endOfStream());
+        ASSERT_FALSE(buffer->receive(data));
+        ASSERT_FALSE(buffer->tryReceive(data));
+    }
+}
+
+TEST_F(ExecutionTest, PipelineDrainTest)
+{
+    std::cout << "[ INFO     ] " << "Test of a pipeline that ends when the source is complete and all items have passed.\n";
+
+    op2.input(op1.output());
+    exec1.opInput(op1.inputAddress());
+    exec1.opOutput(op2.outputAddress());
+    exec1.addOperator(&op1);
+    exec1.addOperator(&op2);
+
+    op4.input(op3.output());
+    exec2.opInput(op3.inputAddress());
+    exec2.opOutput(op4.outputAddress());
+    exec2.addOperator(&op3);
+    exec2.addOperator(&op4);
+
+    source.addOperator(&cSrc);
+    source.opOutput(cSrc.outputAddress());
+
+    sink.addOperator(&cSnk);
+    sink.opInput(cSnk.inputAddress());
+
+    exec1.input(source.output());
+    exec2.input(exec1.output());
+    sink.input(exec2.output());
+
+    Pipeline pipeline("Drain");
+    pipeline.add(source).add(exec1).add(exec2).add(sink);
+    pipeline.start();
+    pipeline.drain();
+
+    // The last value, 37 + 5, is delivered together with the complete status.
+    ASSERT_NEAR(cSnk.getValue(), (std::floor(42*3.1/3)+5.0)/2.0, 1e-5);
+}
+
+TEST(PipelineTest, FinishLosesNoItems)
+{
+    std::cout << "[ INFO     ] " << "Test of ending an endless stream at the source without losing items in flight.\n";
+
+    AddressSource aSrc("address_source", 1000000000);
+    AddressProbe probe("address_probe");
+    AddressSink aSnk("address_sink");
+
+    SourceExecuter<float> source("Source");
+    OperatorExecuter<float,float> exec("Exec");
+    SinkExecuter<float> sink("Sink");
+
+    source.addOperator(&aSrc);
+    source.opOutput(aSrc.outputAddress());
+    exec.addOperator(&probe);
+    exec.opInput(probe.inputAddress());
+    exec.opOutput(probe.outputAddress());
+    sink.addOperator(&aSnk);
+    sink.opInput(aSnk.inputAddress());
+
+    auto ring = make_shared<RingBuffer<float, 4>>("ring");
+    source.output(ring);
+    exec.input(ring);
+    sink.input(exec.output());
+
+    Pipeline pipeline("Finish");
+    pipeline.add(source).add(exec).add(sink);
+    pipeline.start();
+    while (aSnk.received.load() < 100) std::this_thread::yield();
+    pipeline.finish();
+
+    ASSERT_EQ(aSnk.received.load(), aSrc.outputs.size());
+    for (size_t i = 0; i < aSnk.values.size(); i++) ASSERT_EQ(aSnk.values[i], i);
+}
+
+TEST(PipelineTest, BuiltPipelinesRunIndependently)
+{
+    std::cout << "[ INFO     ] " << "Test of two pipelines built from their operators, where one is drained while the other runs.\n";
+
+    // An endless stream, ended later with finish().
+    AddressSource aSrc("address_source", 1000000000);
+    AddressProbe probe("address_probe");
+    AddressSink aSnk("address_sink");
+    Pipeline endless("Endless");
+    endless.source(aSrc).stage(probe, BufferKind::Spsc).sink(aSnk, BufferKind::Ring);
+
+    // The chain of PipelineDrainTest, with a replicated stage.
+    CounterSource cSrc("counter_source", 37);
+    Mult3 op1("Mult3");
+    Div3Round op2("Div3Round");
+    Add5 add0("Add5_0");
+    Add5 add1("Add5_1");
+    Div2 op4("Div2");
+    CounterSink cSnk("counter_sink");
+    Pipeline counting("Counting");
+    counting.source(cSrc)
+            .stage(op1)
+            .stage(op2, BufferKind::Ring)
+            .stage("Add5", std::vector<Add5 *>{&add0, &add1})
+            .stage(op4, BufferKind::Spsc)
+            .sink(cSnk);
+
+    endless.start();
+    counting.start();
+    counting.drain();
+    ASSERT_NEAR(cSnk.getValue(), (std::floor(42*3.1/3)+5.0)/2.0, 1e-5);
+
+    std::vector<StageStats> stats = counting.stats();
+    std::vector<std::string> names{"counter_source", "Mult3", "Div3Round", "Add5", "Div2", "counter_sink"};
+    ASSERT_EQ(stats.size(), names.size());
+    for (size_t i = 0; i < stats.size(); i++)
+    {
+        ASSERT_EQ(stats[i].name, names[i]);
+        ASSERT_GT(stats[i].threadWall, 0u);
+        if (names[i] != "Add5")
+        {
+            ASSERT_EQ(stats[i].compute.count, 6u);
+        }
+    }
+
+    // The first pipeline has kept running, and ends without losing items.
+    size_t received = aSnk.received.load();
+    while (aSnk.received.load() < received + 100) std::this_thread::yield();
+    endless.finish();
+    ASSERT_EQ(aSnk.received.load(), aSrc.outputs.size());
+    for (size_t i = 0; i < aSnk.values.size(); i++) ASSERT_EQ(aSnk.values[i], i);
+    ASSERT_EQ(endless.stats().back().compute.count, aSrc.outputs.size());
+}
+
+TEST(PartitionTest, BalanceMinimisesTheSlowestStage)
+{
+    std::cout << "[ INFO     ] " << "Test of the division of a chain into stages with the smallest bottleneck.\n";
+
+    Partition p = balance({4, 1, 1, 1, 1, 4}, 3);
+    ASSERT_EQ(p.firsts, (std::vector<size_t>{0, 1, 5}));
+    ASSERT_EQ(p.bottleneck, 4u);
+
+    p = balance({1, 2, 3, 4, 5, 6, 7, 8, 9}, 3);
+    ASSERT_EQ(p.bottleneck, 17u);
+    ASSERT_EQ(bottleneck({1, 2, 3, 4, 5, 6, 7, 8, 9}, p.firsts), 17u);
+
+    // More threads than operators gives one stage per operator.
+    p = balance({3, 5}, 4);
+    ASSERT_EQ(p.firsts, (std::vector<size_t>{0, 1}));
+    ASSERT_EQ(p.bottleneck, 5u);
+}
+
+TEST(PartitionTest, ProfiledChainIsRebalancedWhenCostsDrift)
+{
+    std::cout << "[ INFO     ] " << "Test of a chain partitioned from profiled costs, and again after the costs have changed.\n";
+
+    std::vector<std::unique_ptr<Busy>> busy;
+    std::vector<int> costs{400, 100, 100, 100, 100, 400};
+    std::vector<Operator<float, float> *> ops;
+    for (size_t i = 0; i < costs.size(); i++)
+    {
+        busy.emplace_back(std::make_unique<Busy>("Busy" + std::to_string(i), costs[i]));
+        ops.emplace_back(busy.back().get());
+    }
+    ChainPartitioner<float> chain("Chain", ops, 3);
+    chain.profile(std::vector<float>(8, 1.0f));
+    ASSERT_EQ(chain.partition().firsts, (std::vector<size_t>{0, 1, 5}));
+
+    // The middle operator becomes the heavy one while the pipeline runs.
+    busy[0]->microseconds(100);
+    busy[2]->microseconds(400);
+    busy[5]->microseconds(100);
+    AddressSource aSrc("address_source", 100);
+    AddressSink aSnk("address_sink");
+    Pipeline first("First");
+    chain.build(first.source(aSrc)).sink(aSnk);
+    first.start();
+    first.drain();
+    ASSERT_EQ(aSnk.received.load(), 100u);
+    ASSERT_EQ(first.stats().size(), 5u);
+    ASSERT_EQ(first.stats()[2].name, "Chain_1");
+
+    ASSERT_TRUE(chain.update(first.stats()));
+    ASSERT_EQ(chain.partition().firsts, (std::vector<size_t>{0, 2, 3}));
+    ASSERT_FALSE(chain.update(first.stats()));
+
+    // The stream continues in a new pipeline with the new partition, without losing items.
+    AddressSource aSrc2("address_source_2", 100);
+    AddressSink aSnk2("address_sink_2");
+    Pipeline second("Second");
+    chain.build(second.source(aSrc2)).sink(aSnk2);
+    second.start();
+    second.drain();
+    ASSERT_EQ(aSnk2.received.load(), 100u);
+    for (size_t i = 0; i < aSnk2.values.size(); i++) ASSERT_EQ(aSnk2.values[i], i);
+}
+
+TEST(PlacementTest, CpuListsAreParsed)
+{
+    std::cout << "[ INFO     ] " << "Test of reading the CPU lists of the kernel.\n";
+
+    ASSERT_EQ(parseCpuList("0-3,8,10-11\n"), (std::vector<int>{0, 1, 2, 3, 8, 10, 11}));
+    ASSERT_EQ(parseCpuList("5"), (std::vector<int>{5}));
+    std::vector<int> siblings = cacheSiblings(0);
+    ASSERT_NE(std::find(siblings.begin(), siblings.end(), 0), siblings.end());
+}
+
+TEST(PlacementTest, PinnedStageRunsOnItsCpu)
+{
+    std::cout << "[ INFO     ] " << "Test of a stage pinned to one CPU, with its data allocated in its own thread.\n";
+
+    // The last CPU that the process may run on, which need not be the last one of the machine.
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    ASSERT_EQ(sched_getaffinity(0, sizeof(allowed), &allowed), 0);
+    int cpu = CPU_SETSIZE - 1;
+    while ((cpu > 0) && !CPU_ISSET(cpu, &allowed)) cpu--;
+    AddressSource aSrc("address_source", 200);
+    CpuProbe probe("cpu_probe");
+    AddressSink aSnk("address_sink");
+    Pipeline pipeline("Pinned");
+    pipeline.source(aSrc).stage(probe, BufferKind::Ring).sink(aSnk, BufferKind::Spsc);
+
+    ThreadPlacement local;
+    local.localMemory = true;
+    ThreadPlacement pinned = local;
+    pinned.cpus = {cpu};
+    pipeline.executer("address_source")->placement(local);
+    pipeline.executer("cpu_probe")->placement(pinned);
+    pipeline.executer("address_sink")->placement(local);
+    ASSERT_EQ(pipeline.executer("none"), nullptr);
+    pipeline.start();
+    pipeline.drain();
+
+    ASSERT_TRUE(pipeline.executer("cpu_probe")->placed());
+    ASSERT_EQ(probe.cpus.size(), 200u);
+    for (int c : probe.cpus) ASSERT_EQ(c, cpu);
+    ASSERT_EQ(aSnk.received.load(), 200u);
+    for (size_t i = 0; i < aSnk.values.size(); i++) ASSERT_EQ(aSnk.values[i], i);
+}
+
+TEST(BatchTest, BatchedChainGivesTheSameResults)
+{
+    std::cout << "[ INFO     ] " << "Test of the chain of PipelineDrainTest, with four items in each batch.\n";
+
+    CounterSource cSrc("counter_source", 37);
+    Mult3 op1("Mult3");
+    Div3Round op2("Div3Round");
+    Add5 op3("Add5");
+    Div2 op4("Div2");
+    CounterSink cSnk("counter_sink");
+
+    BatchedSource<CounterSource, 4> bSrc("batched_source", cSrc);
+    Batched<Mult3, 4> b1("batched_Mult3", op1);
+    Batched<Div3Round, 4> b2("batched_Div3Round", op2);
+    Batched<Add5, 4> b3("batched_Add5", op3);
+    Batched<Div2, 4> b4("batched_Div2", op4);
+    BatchedSink<CounterSink, 4> bSnk("batched_sink", cSnk);
+
+    Pipeline pipeline("Batched");
+    pipeline.source(bSrc).stage(b1).stage(b2, BufferKind::Spsc).stage(b3).stage(b4).sink(bSnk);
+    pipeline.start();
+    pipeline.drain();
+
+    // The six items 37 to 42 pass in two batches, of four and of two.
+    ASSERT_NEAR(cSnk.getValue(), (std::floor(42*3.1/3)+5.0)/2.0, 1e-5);
+    for (const StageStats & stage : pipeline.stats()) ASSERT_EQ(stage.compute.count, 2u);
+}
+
+TEST(BatchTest, ItemsKeepTheirOrderAcrossBatches)
+{
+    std::cout << "[ INFO     ] " << "Test that items pass in order, where the last batch is not full.\n";
+
+    AddressSource aSrc("address_source", 1000);
+    AddressProbe probe("address_probe");
+    AddressSink aSnk("address_sink");
+    BatchedSource<AddressSource, 64> bSrc("batched_source", aSrc);
+    Batched<AddressProbe, 64> bProbe("batched_probe", probe);
+    BatchedSink<AddressSink, 64> bSnk("batched_sink", aSnk);
+
+    Pipeline pipeline("Ordered");
+    pipeline.source(bSrc).stage(bProbe, BufferKind::Ring).sink(bSnk);
+    pipeline.start();
+    pipeline.drain();
+
+    ASSERT_EQ(aSnk.received.load(), 1000u);
+    for (size_t i = 0; i < aSnk.values.size(); i++) ASSERT_EQ(aSnk.values[i], i);
+    ASSERT_EQ(pipeline.stats().back().compute.count, 16u);
+}
+
+TEST(MetricsTest, HistogramPercentiles)
+{
+    std::cout << "[ INFO     ] " << "Test of the percentiles of a latency histogram.\n";
+
+    LatencyHistogram histogram;
+    for (uint64_t v = 1; v <= 100000; v++) histogram.record(v);
+    LatencySnapshot s = histogram.snapshot();
+    ASSERT_EQ(s.count, 100000u);
+    ASSERT_EQ(s.max, 100000u);
+    ASSERT_EQ(s.mean, 50000u);
+    // Every value is reported with less than 1/32 relative error.
+    ASSERT_NEAR(s.p50, 50000, 50000 / 32);
+    ASSERT_NEAR(s.p99, 99000, 99000 / 32);
+    ASSERT_NEAR(s.p999, 99900, 99900 / 32);
+    ASSERT_GE(s.p50, 50000u);
+
+    // Small values are exact.
+    LatencyHistogram small;
+    for (uint64_t v = 0; v < 10; v++) small.record(v);
+    ASSERT_EQ(small.percentile(50.0), 4u);
+    ASSERT_EQ(small.percentile(100.0), 9u);
+
+    histogram.reset();
+    ASSERT_EQ(histogram.count(), 0u);
+    ASSERT_EQ(histogram.percentile(99.0), 0u);
+}
+
+TEST_F(ExecutionTest, ExecuterMetricsTest)
+{
+    std::cout << "[ INFO     ] " << "Test of the compute and waiting times recorded by an executer.\n";
+
+    Jitter jitter("jitter");
+    jitter.input(op1.output());
+    exec1.opInput(op1.inputAddress());
+    exec1.opOutput(jitter.outputAddress());
+    exec1.addOperator(&op1);
+    exec1.addOperator(&jitter);
+
+    auto input = make_unique<int>();
+    auto output = make_unique<float>();
+
+    exec1.send(ExecutionMode::Continuous);
+    exec1.startThread();
+    for (int i = 0; i < 10; i++)
+    {
+        // 1 * 3.1 makes the jitter operator sleep for 3 ms.
+        *input = 1;
+        exec1.input()->send(input);
+        exec1.output()->receive(output);
+    }
+    exec1.stop();
+    exec1.waitToEnd();
+
+    const ExecuterMetrics & m = exec1.metrics();
+    ASSERT_EQ(m.operators.size(), 2u);
+    ASSERT_EQ(m.operatorNames[1], "jitter");
+    ASSERT_EQ(m.operators[1]->count(), 10u);
+    ASSERT_GE(m.operators[1]->percentile(50.0), 3000000u);
+    ASSERT_LT(m.operators[0]->percentile(50.0), m.operators[1]->percentile(50.0));
+    ASSERT_EQ(m.compute.count(), 10u);
+    ASSERT_GE(m.compute.percentile(50.0), m.operators[1]->percentile(50.0) * 31 / 32);
+    ASSERT_GE(m.receiveWait.count(), 10u);
+    ASSERT_EQ(m.sendWait.count(), 10u);
+    // The thread mostly sleeps in the jitter operator, so it uses less CPU than wall time.
+    ASSERT_GE(m.threadWall.load(), 30000000u);
+    ASSERT_LT(m.threadCpu.load(), m.threadWall.load());
+    exec1.report(std::cout);
+}
+
+#ifdef PIPELINE_TRACE
+TEST_F(ExecutionTest, TraceTest)
+{
+    std::cout << "[ INFO     ] " << "Test of the timeline recorded by the tracer.\n";
+
+    op2.input(op1.output());
+    exec1.opInput(op1.inputAddress());
+    exec1.opOutput(op2.outputAddress());
+    exec1.addOperator(&op1);
+    exec1.addOperator(&op2);
+
+    auto input = make_unique<int>();
+    auto output = make_unique<float>();
+
+    exec1.send(ExecutionMode::Continuous);
+    exec1.startThread();
+    for (int i = 0; i < 5; i++)
+    {
+        *input = i;
+        exec1.input()->send(input);
+        exec1.output()->receive(output);
+    }
+    exec1.stop();
+    exec1.waitToEnd();
 
+    std::stringstream trace;
+    Tracer::instance().dump(trace);
+    std::string json = trace.str();
+    ASSERT_EQ(json.find("{\"displayTimeUnit\":\"ms\",\"traceEvents\":["), 0u);
+    ASSERT_NE(json.find("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"), std::string::npos);
+    ASSERT_NE(json.find("\"args\":{\"name\":\"Exec_1\"}"), std::string::npos);
+    ASSERT_NE(json.find("{\"name\":\"multiply_3.1\",\"cat\":\"operator\",\"ph\":\"X\""), std::string::npos);
+    ASSERT_NE(json.find("{\"name\":\"divide_3_floor\",\"cat\":\"operator\",\"ph\":\"X\""), std::string::npos);
+    ASSERT_NE(json.find("{\"name\":\"Exec_1_input_buffer receive\",\"cat\":\"wait\""), std::string::npos);
+    ASSERT_NE(json.find("{\"name\":\"Exec_1_output_buffer send\",\"cat\":\"wait\""), std::string::npos);
 }
+#endif
@@ -0,0 +1,252 @@
+#include <gtest/gtest.h>
+#include <iostream>
+#include <filesystem>
+#include <vector>
+#include <thread>
+#include <chrono>
+
+/******************************************************************************************
+ * Tests of the video source and sink, which need OpenCV and are therefore built apart from
+ * the tests of the framework. The video is generated by the test, as Motion JPEG in an AVI
+ * file, which OpenCV writes and reads without any external library. Each frame is filled
+ * with a gray level that tells its number, so that the order of the frames can be checked.
+ *
+ * The operators of the face detection demo are tested here too, with the cascades and the
+ * images of input_files.
+ */
+#include <opsexecuter.hpp>
+#include <pipeline.hpp>
+#include <cvvideo.hpp>
+#include <cvoperators.hpp>
+
+#ifndef INPUT_FILES_DIR
+#define INPUT_FILES_DIR "input_files"
+#endif
+
+const std::string cascadeDir = std::string(INPUT_FILES_DIR) + "/haarcascades/";
+
+const int videoFrames = 40;
+const int levelStep = 5;                    // Gray level of frame i is i * levelStep
+
+std::filesystem::path generateVideo(std::string name)
+{
+    std::filesystem::path file = std::filesystem::temp_directory_path() / name;
+    VideoWriter writer;
+    writer.open(file.string(), VideoWriter::fourcc('M', 'J', 'P', 'G'), 25.0, Size(160, 120), true);
+    Mat frame(120, 160, CV_8UC3);
+    for (int i = 0; i < videoFrames; i++)
+    {
+        frame.setTo(Scalar(i * levelStep, i * levelStep, i * levelStep));
+        writer.write(frame);
+    }
+    writer.release();
+    return file;
+}
+
+// Number of the frame, from its gray level, which is not exact after the compression.
+int frameNumber(const Mat & frame)
+{
+    return (int) (mean(frame)[0] / levelStep + 0.5);
+}
+
+// Records the number of every frame, and takes its time over each of them.
+class SlowRecorder : public SinkOperator<ImageData>
+{
+public:
+    SlowRecorder(std::string opName, int milliseconds) : SinkOperator(opName), _milliseconds(milliseconds) {};
+    OperationStatus operation() override
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(_milliseconds));
+        if (!_input->frame.empty()) numbers.push_back(frameNumber(_input->frame));
+        return OperationStatus::running;
+    };
+    std::vector<int> numbers;
+
+private:
+    int _milliseconds;
+};
+
+TEST(VideoTest, EveryFrameIsCopiedInOrder)
+{
+    std::cout << "[ INFO     ] " << "Test that a video passes from the source to the writer, frame by frame.\n";
+
+    std::filesystem::path source = generateVideo("video_test_source.avi");
+    std::filesystem::path destination = std::filesystem::temp_directory_path() / "video_test_copy.avi";
+
+    CVVideoSourceOp reader("Op_videoReader", source.string());
+    ASSERT_TRUE(reader.opened());
+    ASSERT_EQ(reader.frameSize(), Size(160, 120));
+    CVVideoWriterOp writer("Op_videoWriter", destination.string(), reader.fps());
+    SourceExecuter<ImageData> readerThread("ReaderThread");
+    SinkExecuter<ImageData> writerThread("WriterThread");
+    readerThread.addOperator(&reader);
+    readerThread.opOutput(reader.outputAddress());
+    writerThread.addOperator(&writer);
+    writerThread.opInput(writer.inputAddress());
+    writerThread.input(readerThread.output());
+
+    Pipeline pipeline("Video");
+    pipeline.add(readerThread).add(writerThread);
+    pipeline.start();
+    pipeline.drain();
+    ASSERT_EQ(reader.delivered(), (size_t) videoFrames);
+    ASSERT_EQ(reader.dropped(), 0u);
+    ASSERT_EQ(writer.written(), (size_t) videoFrames);
+
+    // The copy has the same frames, in the same order.
+    writer.close();
+    VideoCapture copy;
+    copy.open(destination.string());
+    Mat frame;
+    int count = 0;
+    while (copy.read(frame))
+    {
+        ASSERT_EQ(frameNumber(frame), count);
+        count++;
+    }
+    ASSERT_EQ(count, videoFrames);
+    std::filesystem::remove(source);
+    std::filesystem::remove(destination);
+}
+
+TEST(VideoTest, LatestFrameWinsDropsOldFrames)
+{
+    std::cout << "[ INFO     ] " << "Test that a slow sink gets the latest frames and the others are dropped.\n";
+
+    std::filesystem::path source = generateVideo("video_test_live.avi");
+
+    // Frames arrive every 5 ms and the sink takes 20 ms for each.
+    CVVideoSourceOp reader("Op_videoReader", source.string());
+    SlowRecorder recorder("Op_recorder", 20);
+    reader.latestFrameWins(200.0);
+    SourceExecuter<ImageData> readerThread("ReaderThread");
+    SinkExecuter<ImageData> recorderThread("RecorderThread");
+    readerThread.addOperator(&reader);
+    readerThread.opOutput(reader.outputAddress());
+    recorderThread.addOperator(&recorder);
+    recorderThread.opInput(recorder.inputAddress());
+    recorderThread.input(readerThread.output());
+
+    Pipeline pipeline("LiveVideo");
+    pipeline.add(readerThread).add(recorderThread);
+    pipeline.start();
+    pipeline.drain();
+
+    ASSERT_GT(reader.dropped(), 0u);
+    ASSERT_EQ(reader.delivered() + reader.dropped(), (size_t) videoFrames);
+    ASSERT_EQ(recorder.numbers.size(), reader.delivered());
+    for (size_t i = 1; i < recorder.numbers.size(); i++) ASSERT_GT(recorder.numbers[i], recorder.numbers[i - 1]);
+    // The last frame ends the stream and is never dropped.
+    ASSERT_EQ(recorder.numbers.back(), videoFrames - 1);
+    std::filesystem::remove(source);
+}
+
+TEST(FramePoolTest, ImagesOfSeveralSizesStopCreatingFrames)
+{
+    std::cout << "[ INFO     ] " << "Test that images of different sizes, read again, reuse the frames of the pool.\n";
+
+    std::filesystem::path dir = std::filesystem::temp_directory_path() / "frame_pool_test";
+    std::filesystem::create_directories(dir);
+    std::vector<Size> sizes = {Size(320, 240), Size(200, 300), Size(320, 240), Size(256, 256)};
+    std::vector<std::filesystem::path> images;
+    for (size_t i = 0; i < sizes.size(); i++)
+    {
+        Mat image(sizes[i].height, sizes[i].width, CV_8UC3);
+        randu(image, Scalar(0, 0, 0), Scalar(255, 255, 255));
+        images.emplace_back(dir / ("image_" + std::to_string(i) + ".png"));
+        imwrite(images.back().string(), image);
+    }
+    const int passes = 4;
+    std::vector<std::filesystem::path> sourceFiles;
+    std::vector<std::filesystem::path> destinationFiles;
+    for (int r = 0; r < passes; r++)
+    {
+        for (const std::filesystem::path & p : images)
+        {
+            sourceFiles.emplace_back(p);
+            destinationFiles.emplace_back(dir / (p.stem().string() + "_modified.png"));
+        }
+    }
+
+    CVFileReaderOp reader("Op_fileReader", sourceFiles, destinationFiles);
+    CVFaceDetector detector("FaceDetector", cascadeDir + "haarcascade_frontalface_alt.xml");
+    CVEyeDetector eyes("EyeDetector", cascadeDir + "haarcascade_eye_tree_eyeglasses.xml");
+    CVFileWriterOp writer("Op_fileWriter");
+    ASSERT_TRUE(detector.loaded());
+    ASSERT_TRUE(eyes.loaded());
+    FramePool frames;
+    reader.pool(&frames);
+    detector.pool(&frames);
+    eyes.pool(&frames);
+    writer.pool(&frames);
+    ImageData read;
+    ImageData detected;
+    ImageData drawn;
+    reader.output(&read);
+    detector.input(&read);
+    detector.output(&detected);
+    eyes.input(&detected);
+    eyes.output(&drawn);
+    writer.input(&drawn);
+
+    // The first pass decodes each image into a frame of its own, which the writer returns
+    // to the pool. After it, the frames and the gray images are taken from the pool.
+    std::vector<size_t> created;
+    for (size_t i = 0; i < sourceFiles.size(); i++)
+    {
+        reader.operation();
+        ASSERT_EQ(read.frame.size(), sizes[i % sizes.size()]);
+        detector.operation();
+        eyes.operation();
+        writer.operation();
+        if ((i + 1) % images.size() == 0) created.push_back(frames.created());
+    }
+    ASSERT_GT(created[0], 0u);
+    for (int r = 1; r < passes; r++) ASSERT_EQ(created[r], created[0]);
+    std::filesystem::remove_all(dir);
+}
+
+TEST(FaceDetectorTest, TilesFindTheFacesOfTheWholeImage)
+{
+    std::cout << "[ INFO     ] " << "Test that the face detection in tiles finds the same faces as in the whole image.\n";
+
+    // A group photo, with faces across the borders of the tiles.
+    Mat frame = imread(std::string(INPUT_FILES_DIR) + "/01.jpg", IMREAD_COLOR);
+    ASSERT_FALSE(frame.empty());
+    WorkStealingPool pool(3);
+    CVFaceDetector whole("FaceDetector_whole", cascadeDir + "haarcascade_frontalface_alt.xml");
+    CVFaceDetector tiled("FaceDetector_tiled", cascadeDir + "haarcascade_frontalface_alt.xml");
+    ASSERT_TRUE(whole.loaded());
+    ASSERT_TRUE(tiled.tiled(pool));
+    whole.maxFaceFraction(0.25);
+    tiled.maxFaceFraction(0.25);
+    ImageData input;
+    ImageData wholeOutput;
+    ImageData tiledOutput;
+    whole.input(&input);
+    whole.output(&wholeOutput);
+    tiled.input(&input);
+    tiled.output(&tiledOutput);
+
+    // The detectors swap the frame to their output, so each of them gets a copy.
+    frame.copyTo(input.frame);
+    whole.operation();
+    frame.copyTo(input.frame);
+    tiled.operation();
+
+    const std::vector<Rect> & expected = wholeOutput.faces;
+    const std::vector<Rect> & found = tiledOutput.faces;
+    ASSERT_GT(expected.size(), 1u);
+    ASSERT_EQ(found.size(), expected.size());
+    // The tiles are scaled from other origins than the whole image, so the rectangles of the
+    // same face may differ by a few pixels.
+    for (const Rect & face : expected)
+    {
+        bool matched = false;
+        for (const Rect & other : found)
+        {
+            matched = matched || ((face & other).area() * 2 > std::max(face.area(), other.area()));
+        }
+        ASSERT_TRUE(matched);
+    }
+}